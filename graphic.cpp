@@ -1,7 +1,10 @@
 //
 // Created by schrodinger on 9/9/21.
 //
+#include <SDL_opengl.h>
+#include <cstdint>
 #include <graphic/graphic.hpp>
+#include <graphic/texture.hpp>
 
 graphic::GraphicContext::GraphicContext(std::string title, int height,
                                         int width,
@@ -45,3 +48,43 @@ graphic::GraphicContext::~GraphicContext() {
   SDL_DestroyWindow(sdl_window);
   SDL_Quit();
 }
+
+graphic::Texture::~Texture() {
+  if (name != 0) {
+    glDeleteTextures(1, &name);
+  }
+}
+
+void graphic::Texture::upload(const ImU32 *pixels, int width, int height) {
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+  if (name == 0) {
+    glGenTextures(1, &name);
+    glBindTexture(GL_TEXTURE_2D, name);
+    // every pixel stays a sharp square when scaled up
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  } else {
+    glBindTexture(GL_TEXTURE_2D, name);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  if (width != this->width || height != this->height) {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, pixels);
+    this->width = width;
+    this->height = height;
+  } else {
+    // same size: update in place instead of reallocating the texture
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA,
+                    GL_UNSIGNED_BYTE, pixels);
+  }
+  glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous));
+}
+
+void graphic::Texture::draw(ImVec2 size) const {
+  ImGui::Image(reinterpret_cast<ImTextureID>(static_cast<intptr_t>(name)),
+               size);
+}
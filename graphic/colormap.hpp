@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <imgui.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GRAPHIC_X86 1
+#endif
+
+namespace graphic {
+
+/// Lookup table from small non-negative integers, such as escape times or
+/// quantized temperatures, to packed ImU32 colors. Values past the end of the
+/// table take its last color.
+///
+/// `apply` colors a whole row of values at once; with AVX2 it converts eight
+/// (or four, for doubles) values to indices and fetches their colors with a
+/// single gather.
+class Colormap {
+public:
+  explicit Colormap(size_t size = 1, ImU32 color = 0)
+      : table(std::max<size_t>(size, 1), color) {}
+
+  size_t size() const { return table.size(); }
+
+  ImU32 &operator[](size_t value) { return table[value]; }
+  ImU32 operator[](size_t value) const { return table[value]; }
+
+  /// out[i] = color of values[i]
+  void apply(const uint16_t *values, size_t count, ImU32 *out) const {
+#ifdef GRAPHIC_X86
+    if (has_avx2()) {
+      apply_avx2(values, count, out);
+      return;
+    }
+#endif
+    apply_scalar(values, count, out);
+  }
+
+  /// out[i] = color of values[i] * scale, truncated; negative values and NaN
+  /// take the first color
+  void apply(const double *values, size_t count, double scale,
+             ImU32 *out) const {
+#ifdef GRAPHIC_X86
+    if (has_avx2()) {
+      apply_avx2(values, count, scale, out);
+      return;
+    }
+#endif
+    apply_scalar(values, count, scale, out);
+  }
+
+private:
+  void apply_scalar(const uint16_t *values, size_t count, ImU32 *out) const {
+    auto last = table.size() - 1;
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = table[std::min<size_t>(values[i], last)];
+    }
+  }
+
+  void apply_scalar(const double *values, size_t count, double scale,
+                    ImU32 *out) const {
+    auto last = static_cast<double>(table.size() - 1);
+    for (size_t i = 0; i < count; ++i) {
+      auto index = values[i] * scale;
+      out[i] = index > 0 ? table[static_cast<size_t>(std::min(index, last))]
+                         : table[0];
+    }
+  }
+
+#ifdef GRAPHIC_X86
+  static bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+  }
+
+  __attribute__((target("avx2"))) void
+  apply_avx2(const uint16_t *values, size_t count, ImU32 *out) const {
+    const auto *base = reinterpret_cast<const int *>(table.data());
+    const __m256i last = _mm256_set1_epi32(static_cast<int>(table.size() - 1));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      __m256i index = _mm256_cvtepu16_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i)));
+      index = _mm256_min_epi32(index, last);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                          _mm256_i32gather_epi32(base, index, 4));
+    }
+    apply_scalar(values + i, count - i, out + i);
+  }
+
+  // clamped in double before the conversion; max_pd returns its second
+  // operand for NaN, so NaN ends up at the first color as in apply_scalar
+  __attribute__((target("avx2"))) void apply_avx2(const double *values,
+                                                  size_t count, double scale,
+                                                  ImU32 *out) const {
+    const auto *base = reinterpret_cast<const int *>(table.data());
+    const __m256d factor = _mm256_set1_pd(scale);
+    const __m256d first = _mm256_setzero_pd();
+    const __m256d last = _mm256_set1_pd(static_cast<double>(table.size() - 1));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+      __m256d index = _mm256_mul_pd(_mm256_loadu_pd(values + i), factor);
+      index = _mm256_min_pd(_mm256_max_pd(index, first), last);
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i *>(out + i),
+          _mm_i32gather_epi32(base, _mm256_cvttpd_epi32(index), 4));
+    }
+    apply_scalar(values + i, count - i, scale, out + i);
+  }
+#endif
+
+  std::vector<ImU32> table;
+};
+
+/// temperatures from 0 to 100 in 256 steps, from blue (cold) to red (hot)
+inline Colormap temp_colormap() {
+  Colormap colormap(256);
+  for (int value = 0; value < 256; ++value) {
+    colormap[value] = ImColor(value, 0, 255 - value);
+  }
+  return colormap;
+}
+
+} // namespace graphic
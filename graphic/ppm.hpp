@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <imgui.h>
+
+namespace graphic {
+
+/// Binary PPM (P6) image written in bands of whole rows.
+///
+/// The file is sized up front, so bands can be written at their final offset
+/// in any order and from several writers at once; nothing but the band being
+/// written has to be in memory. The layout helpers are public for writers
+/// that do their own I/O, such as MPI-IO.
+class PpmFile {
+public:
+  static constexpr size_t CHANNELS = 3;
+
+  PpmFile(const std::string &path, size_t width, size_t height)
+      : width(width), height(height) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("cannot open " + path + ": " +
+                               std::strerror(errno));
+    }
+    auto text = header(width, height);
+    if (0 != ::ftruncate(fd, static_cast<off_t>(file_size(width, height)))) {
+      ::close(fd);
+      throw std::runtime_error("cannot resize " + path + ": " +
+                               std::strerror(errno));
+    }
+    write_at(0, text.data(), text.size());
+  }
+
+  PpmFile(const PpmFile &) = delete;
+  PpmFile &operator=(const PpmFile &) = delete;
+
+  ~PpmFile() { ::close(fd); }
+
+  static std::string header(size_t width, size_t height) {
+    return "P6\n" + std::to_string(width) + " " + std::to_string(height) +
+           "\n255\n";
+  }
+
+  /// byte offset of the first pixel of `row`
+  static size_t row_offset(size_t width, size_t height, size_t row) {
+    return header(width, height).size() + row * width * CHANNELS;
+  }
+
+  static size_t file_size(size_t width, size_t height) {
+    return row_offset(width, height, height);
+  }
+
+  /// drop the alpha channel of `count` packed colors into rgb[0, 3 * count)
+  static void to_rgb(const ImU32 *colors, size_t count, unsigned char *rgb) {
+    for (size_t i = 0; i < count; ++i) {
+      auto color = colors[i];
+      rgb[CHANNELS * i] =
+          static_cast<unsigned char>(color >> IM_COL32_R_SHIFT);
+      rgb[CHANNELS * i + 1] =
+          static_cast<unsigned char>(color >> IM_COL32_G_SHIFT);
+      rgb[CHANNELS * i + 2] =
+          static_cast<unsigned char>(color >> IM_COL32_B_SHIFT);
+    }
+  }
+
+  /// write `rows` rows of rgb pixels, starting at row `first_row`
+  void write_rows(size_t first_row, const unsigned char *rgb, size_t rows) {
+    if (first_row + rows > height) {
+      throw std::runtime_error("rows past the end of the image");
+    }
+    write_at(row_offset(width, height, first_row), rgb,
+             rows * width * CHANNELS);
+  }
+
+private:
+  void write_at(size_t offset, const void *data, size_t bytes) {
+    auto bytes_left = bytes;
+    auto from = static_cast<const char *>(data);
+    while (bytes_left > 0) {
+      auto written = ::pwrite(fd, from, bytes_left, static_cast<off_t>(offset));
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        throw std::runtime_error(std::string{"cannot write image: "} +
+                                 std::strerror(errno));
+      }
+      from += written;
+      offset += static_cast<size_t>(written);
+      bytes_left -= static_cast<size_t>(written);
+    }
+  }
+
+  int fd;
+  size_t width, height;
+};
+
+} // namespace graphic
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <imgui.h>
+
+namespace graphic {
+
+/// An OpenGL texture holding an RGBA image that is replaced every frame, so a
+/// whole canvas is drawn with one ImGui::Image instead of one draw command per
+/// pixel. Pixels are ImU32 as built by ImColor, which on little-endian hosts is
+/// R, G, B, A byte order.
+///
+/// The GL texture is created on the first upload and deleted by the
+/// destructor, both of which need the GL context of a GraphicContext: declare
+/// the Texture after the context so it is destroyed first.
+class Texture {
+public:
+  Texture() = default;
+  ~Texture();
+
+  Texture(const Texture &) = delete;
+  Texture &operator=(const Texture &) = delete;
+
+  /// replace the image by width x height row-major pixels
+  void upload(const ImU32 *pixels, int width, int height);
+
+  /// draw the image at the cursor, scaled to `size`
+  void draw(ImVec2 size) const;
+
+private:
+  unsigned int name = 0;
+  int width = 0, height = 0;
+};
+
+} // namespace graphic
@@ -1,13 +1,15 @@
 #include <cstring>
 #include <graphic/graphic.hpp>
 #include <imgui_impl_sdl.h>
+#include <nbody/barnes_hut.hpp>
 #include <nbody/body.hpp>
+#include <nbody/grid.hpp>
 
 template <typename... Args> void UNUSED(Args &&...args [[maybe_unused]]) {}
 
 __global__ void cudaCheckBodies(double *x, double *y, double *vx, 
                                 double *vy, double *ax, double *ay, 
-                                double *m, double *args, const int bodies)
+                                double *args, const int bodies)
 {
   int idx = threadIdx.x + blockDim.x * blockIdx.x;
   double elapse = args[0];
@@ -74,6 +76,23 @@ __global__ void cudaCheckBodies(double *x, double *y, double *vx,
   }
 }
 
+// device array that only grows, so frames of the same or fewer bodies reuse
+// the memory of earlier frames
+struct DeviceBuffer {
+  double *data = nullptr;
+  size_t capacity = 0;
+
+  void reserve(size_t n) {
+    if (n > capacity) {
+      cudaFree(data);
+      cudaMalloc(&data, n * sizeof(double));
+      capacity = n;
+    }
+  }
+
+  ~DeviceBuffer() { cudaFree(data); }
+};
+
 int main(int argc, char **argv) {
 
     // TODO: 
@@ -88,7 +107,7 @@ int main(int argc, char **argv) {
   static float gravity = 100;
   static float space = 800;
   static float radius = 5;
-  static const int bodies = 20;
+  static int bodies = 20;
   static float elapse = 0.1;
   static ImVec4 color = ImVec4(1.0f, 1.0f, 0.4f, 1.0f);
   static float max_mass = 50;
@@ -97,7 +116,13 @@ int main(int argc, char **argv) {
   static float current_space = space;
   static float current_max_mass = max_mass;
   static int current_bodies = bodies;
+  static bool barnes_hut = false;
+  static float theta = 0.5;
+  static bool collision_grid = false;
   BodyPool pool(static_cast<size_t>(bodies), space, max_mass);
+  nbody::BarnesHut tree;
+  nbody::CollisionGrid grid;
+  DeviceBuffer d_x, d_y, d_vx, d_vy, d_ax, d_ay, d_args;
   graphic::GraphicContext context{"Assignment 3 CUDA version"};
   context.run([&](graphic::GraphicContext *context [[maybe_unused]],
                   SDL_Window *) {
@@ -113,14 +138,17 @@ int main(int argc, char **argv) {
     ImGui::DragFloat("Space", &current_space, 10, 200, 1600, "%f");
     ImGui::DragFloat("Gravity", &gravity, 0.5, 0, 1000, "%f");
     ImGui::DragFloat("Radius", &radius, 0.5, 2, 20, "%f");
-    ImGui::DragInt("Bodies", &current_bodies, 1, 2, 100, "%d");
+    ImGui::DragInt("Bodies", &current_bodies, 10, 2, 1000000, "%d");
     ImGui::DragFloat("Elapse", &elapse, 0.1, 0.001, 10, "%f");
     ImGui::DragFloat("Max Mass", &current_max_mass, 0.5, 5, 100, "%f");
+    ImGui::Checkbox("Barnes-Hut", &barnes_hut);
+    ImGui::DragFloat("Theta", &theta, 0.05, 0, 2, "%f");
+    ImGui::Checkbox("Collision Grid", &collision_grid);
     ImGui::ColorEdit4("Color", &color.x);
     if (current_space != space || current_bodies != bodies ||
         current_max_mass != max_mass) {
       space = current_space;
-      // bodies = current_bodies;
+      bodies = current_bodies;
       max_mass = current_max_mass;
       pool = BodyPool{static_cast<size_t>(bodies), space, max_mass};
     }
@@ -129,87 +157,71 @@ int main(int argc, char **argv) {
 
       // pool.update_for_tick(elapse, gravity, space, radius);
 
-      // allocate host memory space
-      // 7 attributes, radius, gravity, elapse
-      // cuda dont support STL, we only have thrust vector
-      double *x =  new double[bodies];
-      double *y =  new double[bodies];
-      double *vx = new double[bodies];
-      double *vy = new double[bodies];
-      double *ax = new double[bodies];
-      double *ay = new double[bodies];
-      double *m = new double[bodies];
-      double *args = new double[4]; // stores elapse, space, radius, collision ratio
-
-      // allocate device memory space
-      double *d_x, *d_y, *d_vx, *d_vy, *d_ax, *d_ay, *d_m, *d_args;
-      cudaMalloc(&d_x, bodies*sizeof(double)); //d_x means device_x_coordinate
-      cudaMalloc(&d_y, bodies*sizeof(double));
-      cudaMalloc(&d_vx, bodies*sizeof(double));
-      cudaMalloc(&d_vy, bodies*sizeof(double));
-      cudaMalloc(&d_ax, bodies*sizeof(double));
-      cudaMalloc(&d_ay, bodies*sizeof(double));
-      cudaMalloc(&d_m, bodies*sizeof(double));
-      cudaMalloc(&d_args, 4*sizeof(double));
+      auto n = pool.size();
+      d_x.reserve(n);
+      d_y.reserve(n);
+      d_vx.reserve(n);
+      d_vy.reserve(n);
+      d_ax.reserve(n);
+      d_ay.reserve(n);
+      d_args.reserve(4);
 
       // initialize host data
       pool.ax.assign(pool.size(), 0);
       pool.ay.assign(pool.size(), 0);
-      for (size_t i = 0; i < pool.size(); ++i) {
-        for (size_t j = i + 1; j < pool.size(); ++j) {
-          // update acceleration
-          pool.check_and_update(pool.get_body(i), pool.get_body(j), radius, gravity);
+      if (barnes_hut) {
+        tree.theta = theta;
+        tree.update(pool, 0, pool.size(), radius, gravity, !collision_grid);
+        if (collision_grid) {
+          grid.update(pool, 0, pool.size(), radius, gravity);
+        }
+      } else {
+        for (size_t i = 0; i < pool.size(); ++i) {
+          for (size_t j = i + 1; j < pool.size(); ++j) {
+            // update acceleration
+            pool.check_and_update(pool.get_body(i), pool.get_body(j), radius, gravity);
+          }
         }
       }
-      for (int i = 0; i < bodies; i++){
-        x[i] = pool.x[i];
-        y[i] = pool.y[i];
-        vx[i] = pool.vx[i];
-        vy[i] = pool.vy[i];
-        ax[i] = pool.ax[i];
-        ay[i] = pool.ay[i];
-        m[i] = pool.m[i];
-      }
-      args[0] = elapse;
-      args[1] = space;
-      args[2] = radius;
-      args[3] = pool.COLLISION_RATIO;
-
-      // copy host data to device data
-
-      cudaMemcpy(d_x, x, bodies*sizeof(double), cudaMemcpyHostToDevice);
-      cudaMemcpy(d_y, y, bodies*sizeof(double), cudaMemcpyHostToDevice);
-      cudaMemcpy(d_vx, vx, bodies*sizeof(double), cudaMemcpyHostToDevice);
-      cudaMemcpy(d_vy, vy, bodies*sizeof(double), cudaMemcpyHostToDevice);
-      cudaMemcpy(d_ax, ax, bodies*sizeof(double), cudaMemcpyHostToDevice);
-      cudaMemcpy(d_ay, ay, bodies*sizeof(double), cudaMemcpyHostToDevice);
-      cudaMemcpy(d_m, m, bodies*sizeof(double), cudaMemcpyHostToDevice);
-      cudaMemcpy(d_args, args, 4*sizeof(double), cudaMemcpyHostToDevice);
+      // stores elapse, space, radius, collision ratio
+      double args[4] = {elapse, space, radius, pool.COLLISION_RATIO};
+
+      // copy host data to device data, the masses are not needed
+      cudaMemcpy(d_x.data, pool.x.data(), n * sizeof(double),
+                 cudaMemcpyHostToDevice);
+      cudaMemcpy(d_y.data, pool.y.data(), n * sizeof(double),
+                 cudaMemcpyHostToDevice);
+      cudaMemcpy(d_vx.data, pool.vx.data(), n * sizeof(double),
+                 cudaMemcpyHostToDevice);
+      cudaMemcpy(d_vy.data, pool.vy.data(), n * sizeof(double),
+                 cudaMemcpyHostToDevice);
+      cudaMemcpy(d_ax.data, pool.ax.data(), n * sizeof(double),
+                 cudaMemcpyHostToDevice);
+      cudaMemcpy(d_ay.data, pool.ay.data(), n * sizeof(double),
+                 cudaMemcpyHostToDevice);
+      cudaMemcpy(d_args.data, args, 4 * sizeof(double),
+                 cudaMemcpyHostToDevice);
 
       // call kernel
-      cudaCheckBodies<<<(bodies + THREAD_NUMS_PER_BLOCK - 1) / THREAD_NUMS_PER_BLOCK, THREAD_NUMS_PER_BLOCK>>>
-      (x, y, vx, vy, ax, ay, m, args, bodies);
+      auto blocks = (static_cast<int>(n) + THREAD_NUMS_PER_BLOCK - 1) /
+                    THREAD_NUMS_PER_BLOCK;
+      cudaCheckBodies<<<blocks, THREAD_NUMS_PER_BLOCK>>>(
+          d_x.data, d_y.data, d_vx.data, d_vy.data, d_ax.data, d_ay.data,
+          d_args.data, static_cast<int>(n));
 
       // copy data back to host
-      cudaMemcpy(x, d_x, bodies*sizeof(double), cudaMemcpyDeviceToHost);
-      cudaMemcpy(y, d_y, bodies*sizeof(double), cudaMemcpyDeviceToHost);
-      cudaMemcpy(vx, d_vx, bodies*sizeof(double), cudaMemcpyDeviceToHost);
-      cudaMemcpy(vy, d_vy, bodies*sizeof(double), cudaMemcpyDeviceToHost);
-      cudaMemcpy(ax, d_ax, bodies*sizeof(double), cudaMemcpyDeviceToHost);
-      cudaMemcpy(ay, d_ay, bodies*sizeof(double), cudaMemcpyDeviceToHost);
-      cudaMemcpy(m, d_m, bodies*sizeof(double), cudaMemcpyDeviceToHost);
-      cudaMemcpy(args, d_args, 4*sizeof(double), cudaMemcpyDeviceToHost);
-
-      for (int i = 0; i < bodies; i++){
-        pool.x[i] = x[i];
-        pool.y[i] = y[i];
-        pool.vx[i] = vx[i];
-        pool.vy[i] = vy[i];
-        pool.ax[i] = ax[i];
-        pool.ay[i] = ay[i];
-        pool.m[i] = m[i];
-      }
-      
+      cudaMemcpy(pool.x.data(), d_x.data, n * sizeof(double),
+                 cudaMemcpyDeviceToHost);
+      cudaMemcpy(pool.y.data(), d_y.data, n * sizeof(double),
+                 cudaMemcpyDeviceToHost);
+      cudaMemcpy(pool.vx.data(), d_vx.data, n * sizeof(double),
+                 cudaMemcpyDeviceToHost);
+      cudaMemcpy(pool.vy.data(), d_vy.data, n * sizeof(double),
+                 cudaMemcpyDeviceToHost);
+      cudaMemcpy(pool.ax.data(), d_ax.data, n * sizeof(double),
+                 cudaMemcpyDeviceToHost);
+      cudaMemcpy(pool.ay.data(), d_ay.data, n * sizeof(double),
+                 cudaMemcpyDeviceToHost);
 
       // for (size_t i = 0; i < pool.size(); ++i) {
       //   // update position and velocity according to acceleration
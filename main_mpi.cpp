@@ -1,9 +1,14 @@
+#include <cstddef>
 #include <cstring>
 #include <graphic/graphic.hpp>
 #include <imgui_impl_sdl.h>
 #include <mpi.h>
+#include <nbody/barnes_hut.hpp>
 #include <nbody/body.hpp>
+#include <nbody/grid.hpp>
+#include <nbody/replicated.hpp>
 #include <omp.h>
+#include <vector>
 
 int main(int argc, char **argv) {
 
@@ -11,52 +16,122 @@ int main(int argc, char **argv) {
   int mpi_size, mpi_rank;
   MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
   MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
-  int mpi_tag = 0;
-  int stop_tag = 1;
-  int stop_flag = 0;
 
   static float gravity = 100;
   static float space = 800;
   static float radius = 5;
-  static const int bodies = 200;
+  static int bodies = 200;
   static float elapse = 0.05; // manually set
   static ImVec4 color = ImVec4(1.0f, 1.0f, 0.4f, 1.0f);
   static float max_mass = 50;
   static float current_space = space;
   static float current_max_mass = max_mass;
   static int current_bodies = bodies;
-
-  // struct buffer to send the whole struct
-  struct My_Buffer {
-    double x[bodies];
-    double y[bodies];
-    double vx[bodies];
-    double vy[bodies];
-    double ax[bodies];
-    double ay[bodies];
-    double m[bodies];
+  static bool barnes_hut = false;
+  static float theta = 0.5;
+  static bool collision_grid = false;
+  static bool reset = false;
+
+  // state of one body gathered every frame; collisions need the velocities
+  // of the neighbours as well, the masses only change with the pool
+  struct Body_State {
+    double x, y, vx, vy;
   };
 
-  MPI_Datatype MPI_Pool;
-  MPI_Datatype type_list[7] = {MPI_DOUBLE, MPI_DOUBLE, MPI_DOUBLE, MPI_DOUBLE,
-                               MPI_DOUBLE, MPI_DOUBLE, MPI_DOUBLE};
-  int block_lens[7] = {bodies, bodies, bodies, bodies, bodies, bodies, bodies};
-  MPI_Aint offsets[7];
-  offsets[0] = offsetof(My_Buffer, x);
-  offsets[1] = offsetof(My_Buffer, y);
-  offsets[2] = offsetof(My_Buffer, vx);
-  offsets[3] = offsetof(My_Buffer, vy);
-  offsets[4] = offsetof(My_Buffer, ax);
-  offsets[5] = offsetof(My_Buffer, ay);
-  offsets[6] = offsetof(My_Buffer, m);
-  MPI_Type_create_struct(7, block_lens, offsets, type_list, &MPI_Pool);
-  MPI_Type_commit(&MPI_Pool);
-
-  size_t sub_size = bodies / mpi_size;
-  size_t start_index = mpi_rank * sub_size;
+  MPI_Datatype MPI_Body;
+  MPI_Datatype type_list[4] = {MPI_DOUBLE, MPI_DOUBLE, MPI_DOUBLE,
+                               MPI_DOUBLE};
+  int block_lens[4] = {1, 1, 1, 1};
+  MPI_Aint offsets[4];
+  offsets[0] = offsetof(Body_State, x);
+  offsets[1] = offsetof(Body_State, y);
+  offsets[2] = offsetof(Body_State, vx);
+  offsets[3] = offsetof(Body_State, vy);
+  MPI_Type_create_struct(4, block_lens, offsets, type_list, &MPI_Body);
+  MPI_Type_commit(&MPI_Body);
 
   BodyPool pool(static_cast<size_t>(bodies), space, max_mass);
-  struct My_Buffer buffer;
+  // the buffers below only grow, so sweeping the body count back and forth
+  // reuses their memory instead of reallocating every reset
+  std::vector<Body_State> states;
+  std::vector<int> counts(mpi_size), displs(mpi_size);
+  size_t start_index = 0, end_index = 0;
+  // parameters of a frame, broadcast by rank 0: stop, reset, gravity,
+  // radius, elapse, space, Barnes-Hut, theta, collision grid and bodies
+  constexpr int frame_size = 10;
+  double frame[frame_size] = {};
+  frame[9] = bodies;
+  nbody::BarnesHut tree;
+  nbody::CollisionGrid grid;
+  nbody::SliceUpdate slice;
+
+  // every rank starts from the pool of rank 0, with frame[9] bodies in
+  // contiguous slices; the first n % mpi_size ranks own one body more
+  auto share_pool = [&] {
+    auto n = static_cast<int>(frame[9]);
+    if (mpi_rank != 0) {
+      for (auto *array : {&pool.x, &pool.y, &pool.vx, &pool.vy, &pool.ax,
+                          &pool.ay, &pool.m}) {
+        array->resize(n);
+      }
+    }
+    MPI_Bcast(pool.x.data(), n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(pool.y.data(), n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(pool.vx.data(), n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(pool.vy.data(), n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(pool.m.data(), n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    states.resize(n);
+    for (int i = 0; i < mpi_size; ++i) {
+      counts[i] = n / mpi_size + (i < n % mpi_size);
+      displs[i] = i == 0 ? 0 : displs[i - 1] + counts[i - 1];
+    }
+    start_index = displs[mpi_rank];
+    end_index = start_index + counts[mpi_rank];
+  };
+
+  // advance the own slice by one frame, then gather all slices
+  auto tick = [&] {
+    auto radius = frame[3], gravity = frame[2];
+    bool use_grid = frame[8] != 0;
+    slice.start(pool, start_index, end_index);
+    if (frame[6] != 0) {
+      tree.theta = frame[7];
+      tree.build(pool);
+      for (auto i = start_index; i < end_index; ++i) {
+        tree.accelerate(pool, i, radius, gravity, [&](size_t j) {
+          if (!use_grid) {
+            slice.collide(pool, i, j, radius);
+          }
+        });
+      }
+    } else {
+      slice.pairwise(pool, radius, gravity, !use_grid);
+    }
+    if (use_grid) {
+      grid.build(pool, radius);
+      for (auto i = start_index; i < end_index; ++i) {
+        grid.for_each_neighbour(pool, i, radius, [&](size_t j) {
+          slice.collide(pool, i, j, radius);
+        });
+      }
+    }
+    slice.finish(pool, frame[4], frame[5], radius);
+
+    for (auto i = start_index; i < end_index; ++i) {
+      states[i] = {pool.x[i], pool.y[i], pool.vx[i], pool.vy[i]};
+    }
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, states.data(),
+                   counts.data(), displs.data(), MPI_Body, MPI_COMM_WORLD);
+    for (size_t i = 0; i < states.size(); ++i) {
+      pool.x[i] = states[i].x;
+      pool.y[i] = states[i].y;
+      pool.vx[i] = states[i].vx;
+      pool.vy[i] = states[i].vy;
+    }
+  };
+
+  share_pool();
 
   if (mpi_rank == 0) {
     graphic::GraphicContext context{"Assignment 3 MPI Version"};
@@ -74,68 +149,39 @@ int main(int argc, char **argv) {
       ImGui::DragFloat("Space", &current_space, 10, 200, 1600, "%f");
       ImGui::DragFloat("Gravity", &gravity, 0.5, 0, 1000, "%f");
       ImGui::DragFloat("Radius", &radius, 0.5, 2, 20, "%f");
-      ImGui::DragInt("Bodies", &current_bodies, 1, 2, 100, "%d");
+      ImGui::DragInt("Bodies", &current_bodies, 10, 2, 1000000, "%d");
       ImGui::DragFloat("Elapse", &elapse, 0.05, 0.001, 10, "%f");
       ImGui::DragFloat("Max Mass", &current_max_mass, 0.5, 5, 100, "%f");
+      ImGui::Checkbox("Barnes-Hut", &barnes_hut);
+      ImGui::DragFloat("Theta", &theta, 0.05, 0, 2, "%f");
+      ImGui::Checkbox("Collision Grid", &collision_grid);
       ImGui::ColorEdit4("Color", &color.x);
       if (current_space != space || current_bodies != bodies ||
           current_max_mass != max_mass) {
         space = current_space;
-        // bodies = current_bodies;
+        bodies = current_bodies;
         max_mass = current_max_mass;
         pool = BodyPool{static_cast<size_t>(bodies), space, max_mass};
+        reset = true;
       }
       {
         const ImVec2 p = ImGui::GetCursorScreenPos();
 
-        for (int i = 1; i < mpi_size; i++) {
-          MPI_Send(&stop_flag, 1, MPI_INT, i, stop_tag, MPI_COMM_WORLD);
-        }
-
-        // pool.update_for_tick(elapse, gravity, space, radius);
-        pool.ax.assign(pool.size(), 0);
-        pool.ay.assign(pool.size(), 0);
-
-        for (int i = 0; i < bodies; i++) {
-          buffer.x[i] = pool.x[i];
-          buffer.y[i] = pool.y[i];
-          buffer.vx[i] = pool.vx[i];
-          buffer.vy[i] = pool.vy[i];
-          buffer.ax[i] = pool.ax[i];
-          buffer.ay[i] = pool.ay[i];
-          buffer.m[i] = pool.m[i];
-        }
-
-        for (int i = 1; i < mpi_size; i++) {
-          MPI_Send(&buffer, 1, MPI_Pool, i, mpi_tag, MPI_COMM_WORLD);
-        }
-
-        for (size_t i = start_index; i < start_index + sub_size; ++i) {
-          for (size_t j = i + 1; j < pool.size(); ++j) {
-            // update acceleration
-            pool.check_and_update(pool.get_body(i), pool.get_body(j), radius,
-                                  gravity);
-          }
-        }
-
-        for (size_t i = start_index; i < start_index + sub_size; ++i) {
-          // update position and velocity according to acceleration
-          pool.get_body(i).update_for_tick(elapse, space, radius);
-        }
-
-        for (int i = 1; i < mpi_size; i++) {
-          MPI_Recv(&buffer, 1, MPI_Pool, i, mpi_tag, MPI_COMM_WORLD,
-                   MPI_STATUS_IGNORE);
-          for (size_t j = i * sub_size; j < i * sub_size + sub_size; j++) {
-            pool.x[j] = buffer.x[j];
-            pool.y[j] = buffer.y[j];
-            pool.vx[j] = buffer.vx[j];
-            pool.vy[j] = buffer.vy[j];
-            pool.ax[j] = buffer.ax[j];
-            pool.ay[j] = buffer.ay[j];
-            pool.m[j] = buffer.m[j];
-          }
+        frame[1] = reset;
+        frame[2] = gravity;
+        frame[3] = radius;
+        frame[4] = elapse;
+        frame[5] = space;
+        frame[6] = barnes_hut;
+        frame[7] = theta;
+        frame[8] = collision_grid;
+        frame[9] = bodies;
+        MPI_Bcast(frame, frame_size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        if (reset) {
+          share_pool();
+          reset = false;
         }
+        tick();
 
         for (size_t i = 0; i < pool.size(); ++i) {
           auto body = pool.get_body(i);
@@ -147,10 +193,8 @@ int main(int argc, char **argv) {
       ImGui::End();
 
       if (context->finished) {
-        stop_flag = 1;
-        for (int i = 1; i < mpi_size; i++) {
-          MPI_Send(&stop_flag, 1, MPI_INT, i, stop_tag, MPI_COMM_WORLD);
-        }
+        frame[0] = 1;
+        MPI_Bcast(frame, frame_size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
       }
     });
   }
@@ -158,52 +202,16 @@ int main(int argc, char **argv) {
   // Else, for child Processes
   else {
     while (true) {
-
-      MPI_Recv(&stop_flag, 1, MPI_INT, 0, stop_tag, MPI_COMM_WORLD,
-               MPI_STATUS_IGNORE);
-      if (stop_flag == 1) {
+      MPI_Bcast(frame, frame_size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+      if (frame[0] != 0) {
         break;
       }
-
-      MPI_Recv(&buffer, 1, MPI_Pool, 0, mpi_tag, MPI_COMM_WORLD,
-               MPI_STATUS_IGNORE);
-
-      for (int i = 0; i < bodies; i++) {
-        pool.x[i] = buffer.x[i];
-        pool.y[i] = buffer.y[i];
-        pool.vx[i] = buffer.vx[i];
-        pool.vy[i] = buffer.vy[i];
-        pool.ax[i] = buffer.ax[i];
-        pool.ay[i] = buffer.ay[i];
-        pool.m[i] = buffer.m[i];
+      if (frame[1] != 0) {
+        share_pool();
       }
-
-      for (size_t i = start_index; i < start_index + sub_size; ++i) {
-        for (size_t j = i + 1; j < pool.size(); ++j) {
-          // update acceleration
-          pool.check_and_update(pool.get_body(i), pool.get_body(j), radius,
-                                gravity);
-        }
-      }
-
-      for (size_t i = start_index; i < start_index + sub_size; ++i) {
-        // update position and velocity according to acceleration
-        pool.get_body(i).update_for_tick(elapse, space, radius);
-      }
-
-      for (size_t i = start_index; i < start_index + sub_size; i++) {
-        buffer.x[i] = pool.x[i];
-        buffer.y[i] = pool.y[i];
-        buffer.vx[i] = pool.vx[i];
-        buffer.vy[i] = pool.vy[i];
-        buffer.ax[i] = pool.ax[i];
-        buffer.ay[i] = pool.ay[i];
-        buffer.m[i] = pool.m[i];
-      }
-
-      MPI_Send(&buffer, 1, MPI_Pool, 0, mpi_tag, MPI_COMM_WORLD);
+      tick();
     }
   }
-  MPI_Type_free(&MPI_Pool);
+  MPI_Type_free(&MPI_Body);
   MPI_Finalize();
 }
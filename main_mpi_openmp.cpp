@@ -1,17 +1,15 @@
 #include <chrono>
 #include <cstring>
+#include <graphic/colormap.hpp>
 #include <graphic/graphic.hpp>
+#include <graphic/texture.hpp>
 #include <hdist/hdist.hpp>
 #include <imgui_impl_sdl.h>
 #include <mpi.h>
+#include <vector>
 
 template <typename... Args> void UNUSED(Args &&...args [[maybe_unused]]) {}
 
-ImColor temp_to_color(double temp) {
-  auto value = static_cast<uint8_t>(temp / 100.0 * 255.0);
-  return {value, 0, 255 - value};
-}
-
 int main(int argc, char **argv) {
   MPI_Init(&argc, &argv);
   int mpi_size, mpi_rank;
@@ -37,6 +35,10 @@ int main(int argc, char **argv) {
     static std::chrono::high_resolution_clock::time_point begin, end;
     static const char *algo_list[2] = {"jacobi", "sor"};
     graphic::GraphicContext context{"Assignment 4 - MPI Implementation"};
+    graphic::Texture texture;
+    auto colormap = graphic::temp_colormap();
+    std::vector<double> temperatures;
+    std::vector<ImU32> pixels;
 
     context.run([&](graphic::GraphicContext *context [[maybe_unused]],
                     SDL_Window *) {
@@ -46,7 +48,6 @@ int main(int argc, char **argv) {
       ImGui::Begin("Assignment 4 - MPI Implementation", nullptr,
                    ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse |
                        ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
-      ImDrawList *draw_list = ImGui::GetWindowDrawList();
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                   1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
       ImGui::DragInt("Room Size", &current_state.room_size, 10, 200, 1600,
@@ -169,21 +170,23 @@ int main(int argc, char **argv) {
       }
 
       const ImVec2 p = ImGui::GetCursorScreenPos();
-      float x = p.x + current_state.block_size,
-            y = p.y + current_state.block_size;
-      for (size_t i = 0; i < current_state.room_size; ++i) {
-        for (size_t j = 0; j < current_state.room_size; ++j) {
-          auto temp = grid[{i, j}];
-          auto color = temp_to_color(temp);
-          draw_list->AddRectFilled(ImVec2(x, y),
-                                   ImVec2(x + current_state.block_size,
-                                          y + current_state.block_size),
-                                   color);
-          y += current_state.block_size;
+      auto room_size = static_cast<size_t>(current_state.room_size);
+      temperatures.resize(room_size * room_size);
+      pixels.resize(room_size * room_size);
+      // cell (i, j) is shown in column i, row j
+      for (size_t j = 0; j < room_size; ++j) {
+        for (size_t i = 0; i < room_size; ++i) {
+          temperatures[j * room_size + i] = grid[{i, j}];
         }
-        x += current_state.block_size;
-        y = p.y + current_state.block_size;
       }
+      colormap.apply(temperatures.data(), temperatures.size(), 255.0 / 100.0,
+                     pixels.data());
+      texture.upload(pixels.data(), current_state.room_size,
+                     current_state.room_size);
+      ImGui::SetCursorScreenPos(ImVec2(p.x + current_state.block_size,
+                                       p.y + current_state.block_size));
+      auto extent = current_state.block_size * static_cast<float>(room_size);
+      texture.draw(ImVec2(extent, extent));
       ImGui::End();
 
       // close child processes
@@ -1,57 +1,47 @@
+#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <graphic/colormap.hpp>
 #include <graphic/graphic.hpp>
+#include <graphic/texture.hpp>
 #include <hdist/hdist.hpp>
 #include <imgui_impl_sdl.h>
+#include <parallel/thread_pool.hpp>
+#include <parallel/work_stealing.hpp>
 #include <pthread.h>
+#include <vector>
 
 template <typename... Args> void UNUSED(Args &&...args [[maybe_unused]]) {}
 
-ImColor temp_to_color(double temp) {
-  auto value = static_cast<uint8_t>(temp / 100.0 * 255.0);
-  return {value, 0, 255 - value};
-}
-
 struct Pthread_Arg {
   hdist::Grid *grid;
   hdist::State *state;
   bool *stabilized;
   pthread_mutex_t *lock_on_stablized;
-  int *line_remain;
-  pthread_mutex_t *lock_on_line_remain;
-  int start_index;
+  parallel::TileScheduler *scheduler;
+  int worker;
 };
 
 void *pthreadJacobi(void *argp) {
   struct Pthread_Arg *args = (struct Pthread_Arg *)argp;
-  int start_index = args->start_index;
   bool sub_stabilized = true;
-  int room_size = (*(args->state)).room_size;
-
-  while (true) {
-    for (size_t j = 0; j < room_size; ++j) {
-      auto result =
-          update_single(start_index, j, *(args->grid), *(args->state));
-
-      sub_stabilized &= result.stable;
-      (*(args->grid))[{hdist::alt, start_index, j}] = result.temp;
-    }
 
-    // dynamic scheduling
-    pthread_mutex_lock(args->lock_on_line_remain);
-    if (*(args->line_remain) <= 0) {
-      pthread_mutex_unlock(args->lock_on_line_remain);
-      pthread_exit(0);
-    } else {
-      start_index = --*(args->line_remain);
-      pthread_mutex_unlock(args->lock_on_line_remain);
+  // dynamic scheduling: own tiles first, then steal from the others
+  parallel::Tile tile;
+  while (args->scheduler->next(args->worker, tile)) {
+    for (size_t i = tile.row_begin; i < tile.row_end; ++i) {
+      for (size_t j = tile.col_begin; j < tile.col_end; ++j) {
+        auto result = update_single(i, j, *(args->grid), *(args->state));
+        sub_stabilized &= result.stable;
+        (*(args->grid))[{hdist::alt, i, j}] = result.temp;
+      }
     }
-
-    // need to work on the meaning of stablized
-    pthread_mutex_lock(args->lock_on_stablized);
-    (*(args->stabilized)) &= sub_stabilized;
-    pthread_mutex_unlock(args->lock_on_stablized);
   }
+
+  pthread_mutex_lock(args->lock_on_stablized);
+  (*(args->stabilized)) &= sub_stabilized;
+  pthread_mutex_unlock(args->lock_on_stablized);
+  return nullptr;
 }
 
 int main(int argc, char **argv) {
@@ -59,11 +49,17 @@ int main(int argc, char **argv) {
   bool first = true;
   bool finished = false;
   static int pthread_nums = 8;
+  static int tile_size = 32;
 
   static hdist::State current_state, last_state;
   static std::chrono::high_resolution_clock::time_point begin, end;
   static const char *algo_list[2] = {"jacobi", "sor"};
+  parallel::ThreadPool pool{pthread_nums};
   graphic::GraphicContext context{"Assignment 4 - P-Thread Implementation"};
+  graphic::Texture texture;
+  auto colormap = graphic::temp_colormap();
+  std::vector<double> temperatures;
+  std::vector<ImU32> pixels;
   auto grid = hdist::Grid{static_cast<size_t>(current_state.room_size),
                           current_state.border_temp, current_state.source_temp,
                           static_cast<size_t>(current_state.source_x),
@@ -72,15 +68,13 @@ int main(int argc, char **argv) {
   context.run([&](graphic::GraphicContext *context [[maybe_unused]],
                   SDL_Window *) {
     auto io = ImGui::GetIO();
-    pthread_mutex_t lock_on_line_remain;
-    pthread_mutex_t lock_on_stablized;
+    pthread_mutex_t lock_on_stablized = PTHREAD_MUTEX_INITIALIZER;
 
     ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
     ImGui::SetNextWindowSize(io.DisplaySize);
     ImGui::Begin("Assignment 4 - P-Thread Implementation", nullptr,
                  ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse |
                      ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
-    ImDrawList *draw_list = ImGui::GetWindowDrawList();
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
     ImGui::DragInt("Room Size", &current_state.room_size, 10, 200, 1600, "%d");
@@ -96,6 +90,7 @@ int main(int argc, char **argv) {
                    current_state.room_size - 2, "%d");
     ImGui::DragFloat("Tolerance", &current_state.tolerance, 0.01, 0.01, 1,
                      "%f");
+    ImGui::DragInt("Tile Size", &tile_size, 1, 1, 256, "%d");
     ImGui::ListBox("Algorithm", reinterpret_cast<int *>(&current_state.algo),
                    algo_list, 2);
 
@@ -132,34 +127,26 @@ int main(int argc, char **argv) {
       bool stabilized = true;
 
       // initialize pthread variables
-
-      int line_remain = current_state.room_size - pthread_nums;
-
+      parallel::TileScheduler scheduler;
       std::vector<struct Pthread_Arg> argp(pthread_nums);
-      std::vector<pthread_t> tids(pthread_nums);
 
       switch (current_state.algo) {
       case hdist::Algorithm::Jacobi:
 
-        // create child threads
+        scheduler.reset(current_state.room_size, current_state.room_size,
+                        tile_size, tile_size, pthread_nums);
+
         for (int i = 0; i < pthread_nums; i++) {
           argp[i].state = &current_state;
           argp[i].grid = &grid;
           argp[i].stabilized = &stabilized;
-          argp[i].line_remain = &line_remain;
-          argp[i].lock_on_line_remain = &lock_on_line_remain;
           argp[i].lock_on_stablized = &lock_on_stablized;
-          argp[i].start_index = current_state.room_size - i - 1;
-
-          pthread_attr_t attr;
-          pthread_attr_init(&attr);
-          pthread_create(&tids[i], &attr, pthreadJacobi, &argp[i]);
+          argp[i].scheduler = &scheduler;
+          argp[i].worker = i;
         }
 
-        // join child processes
-        for (int i = 0; i < pthread_nums; i++) {
-          pthread_join(tids[i], NULL);
-        }
+        // one iteration on the long-lived workers
+        pool.run([&](int worker) { pthreadJacobi(&argp[worker]); });
 
         grid.switch_buffer();
         finished = stabilized;
@@ -192,22 +179,33 @@ int main(int argc, char **argv) {
               .count());
     }
 
+    {
+      const auto &phases = pool.phases();
+      auto frames = std::max<size_t>(phases.frames, 1);
+      ImGui::Text("per iteration (ns): dispatch %zu, compute %zu, "
+                  "imbalance %zu, sync %zu",
+                  phases.dispatch / frames, phases.compute / frames,
+                  phases.imbalance / frames, phases.sync / frames);
+    }
+
     const ImVec2 p = ImGui::GetCursorScreenPos();
-    float x = p.x + current_state.block_size,
-          y = p.y + current_state.block_size;
-    for (size_t i = 0; i < current_state.room_size; ++i) {
-      for (size_t j = 0; j < current_state.room_size; ++j) {
-        auto temp = grid[{i, j}];
-        auto color = temp_to_color(temp);
-        draw_list->AddRectFilled(
-            ImVec2(x, y),
-            ImVec2(x + current_state.block_size, y + current_state.block_size),
-            color);
-        y += current_state.block_size;
+    auto room_size = static_cast<size_t>(current_state.room_size);
+    temperatures.resize(room_size * room_size);
+    pixels.resize(room_size * room_size);
+    // cell (i, j) is shown in column i, row j
+    for (size_t j = 0; j < room_size; ++j) {
+      for (size_t i = 0; i < room_size; ++i) {
+        temperatures[j * room_size + i] = grid[{i, j}];
       }
-      x += current_state.block_size;
-      y = p.y + current_state.block_size;
     }
+    colormap.apply(temperatures.data(), temperatures.size(), 255.0 / 100.0,
+                   pixels.data());
+    texture.upload(pixels.data(), current_state.room_size,
+                   current_state.room_size);
+    ImGui::SetCursorScreenPos(ImVec2(p.x + current_state.block_size,
+                                     p.y + current_state.block_size));
+    auto extent = current_state.block_size * static_cast<float>(room_size);
+    texture.draw(ImVec2(extent, extent));
     ImGui::End();
   });
 }
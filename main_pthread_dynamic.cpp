@@ -1,83 +1,203 @@
 #include <chrono>
-#include <complex>
+#include <cmath>
 #include <cstring>
+#include <graphic/colormap.hpp>
 #include <graphic/graphic.hpp>
 #include <imgui_impl_sdl.h>
 #include <iostream>
+#include <mandelbrot/auto_k.hpp>
+#include <mandelbrot/bench.hpp>
+#include <mandelbrot/canvas.hpp>
+#include <mandelbrot/frame_cache.hpp>
+#include <mandelbrot/kernel.hpp>
+#include <mandelbrot/painter.hpp>
+#include <mandelbrot/perturbation.hpp>
+#include <mandelbrot/poster.hpp>
+#include <mandelbrot/render.hpp>
+#include <parallel/thread_pool.hpp>
+#include <parallel/work_stealing.hpp>
 #include <pthread.h>
+#include <string>
 #include <vector>
 
-struct Square {
-  std::vector<int> buffer;
-  size_t length;
-
-  explicit Square(size_t length) : buffer(length), length(length * length) {}
-
-  void resize(size_t new_length) {
-    buffer.assign(new_length * new_length, false);
-    length = new_length;
-  }
-
-  auto &operator[](std::pair<size_t, size_t> pos) {
-    return buffer[pos.second * length + pos.first];
-  }
-};
+using Square = mandelbrot::Square<>;
 
 struct Pthread_Arg {
-  struct Square *buffer;
+  Square *buffer;
 
-  int start_index;
-  int *task_remain;
-  pthread_mutex_t *lock;
+  int worker;
+  parallel::TileScheduler *scheduler;
   int size;
   int scale, k_value;
+  double tolerance;
   double x_center, y_center;
+  mandelbrot::Kernel kernel;
+  mandelbrot::AutoK *auto_k;
+  const mandelbrot::Perturbation *perturbation;
+  uint64_t saved;
 };
 
 void *mandelbrotPThreadCal(void *argp) {
   struct Pthread_Arg *args = (struct Pthread_Arg *)argp;
-  int i = args->start_index;
-
-  double cx = static_cast<double>(args->size) / 2 + args->x_center;
-  double cy = static_cast<double>(args->size) / 2 + args->y_center;
-  double zoom_factor = static_cast<double>(args->size) / 4 * args->scale;
-
-  while (true) {
-    for (int j = 0; j < args->size; ++j) {
-      double x = (static_cast<double>(j) - cx) / zoom_factor;
-      double y = (static_cast<double>(i) - cy) / zoom_factor;
-      std::complex<double> z{0, 0};
-      std::complex<double> c{x, y};
-      int k = 0;
-      do {
-        z = z * z + c;
-        k++;
-      } while (norm(z) < 2.0 && k < args->k_value);
-
-      (*(args->buffer))[{i, j}] = k;
+
+  mandelbrot::View view{args->size, args->scale, args->x_center,
+                        args->y_center};
+  std::vector<int> row(args->size);
+
+  // dynamic scheduling: own tiles first, then steal from the others
+  parallel::Tile tile;
+  args->saved = 0;
+  while (args->scheduler->next(args->worker, tile)) {
+    if (args->perturbation) {
+      args->saved += mandelbrot::render_tile(*(args->buffer), tile,
+                                             *args->perturbation, row);
+    } else {
+      args->saved += mandelbrot::render_tile(*(args->buffer), tile, view,
+                                             {args->k_value, args->tolerance},
+                                             args->kernel, row, args->auto_k);
     }
+  }
+  return nullptr;
+}
 
-    // dynamic scheduling
-    pthread_mutex_lock(args->lock);
-    if (*(args->task_remain) <= 0) {
-      pthread_mutex_unlock(args->lock);
-      pthread_exit(0);
-    } else
-      i = --*(args->task_remain);
-    pthread_mutex_unlock(args->lock);
+// compute the pixels of `regions`, each through a fresh round of the scheduler
+uint64_t render(Square &canvas, const std::vector<parallel::Tile> &regions,
+                int size, int scale, double x_center, double y_center,
+                mandelbrot::Budget budget, parallel::ThreadPool &pool,
+                int tile_size, mandelbrot::Kernel kernel,
+                mandelbrot::AutoK *auto_k,
+                const mandelbrot::Perturbation *perturbation = nullptr) {
+  int pthread_nums = pool.size();
+  parallel::TileScheduler scheduler;
+  std::vector<struct Pthread_Arg> argp(pthread_nums);
+  if (perturbation) {
+    // perturbed rows never report their escape times to the caps
+    auto_k = nullptr;
+  }
+  if (auto_k) {
+    auto_k->begin_frame(size, budget.k_value);
   }
+
+  for (int i = 0; i < pthread_nums; ++i) {
+    // Initialize arguments for the parallel function
+    argp[i].buffer = &canvas;
+    argp[i].worker = i;
+    argp[i].scheduler = &scheduler;
+    argp[i].size = size;
+    argp[i].scale = scale;
+    argp[i].k_value = budget.k_value;
+    argp[i].tolerance = budget.tolerance;
+    argp[i].x_center = x_center;
+    argp[i].y_center = y_center;
+    argp[i].kernel = kernel;
+    argp[i].auto_k = auto_k;
+    argp[i].perturbation = perturbation;
+  }
+  uint64_t saved = 0;
+  for (const auto &region : regions) {
+    scheduler.reset(region, tile_size, tile_size, pthread_nums);
+    pool.run([&](int worker) { mandelbrotPThreadCal(&argp[worker]); });
+    for (const auto &arg : argp) {
+      saved += arg.saved;
+    }
+  }
+  if (auto_k) {
+    auto_k->end_frame();
+  }
+  return saved;
+}
+
+static const ImVec4 CORE_COLOR = ImVec4(1.0f, 1.0f, 1.0f, 1.0f);
+static const ImVec4 INNER_COLOR = ImVec4(0.6f, 0.2f, 1.0f, 1.0f);
+static const ImVec4 OUTER_COLOR = ImVec4(0.1f, 0.1f, 0.8f, 1.0f);
+
+// points of the set take `core`, slow escapes `inner`, faster ones `outer`
+// and the fastest stay black
+graphic::Colormap tiered_colormap(int k_value, ImU32 core, ImU32 inner,
+                                  ImU32 outer) {
+  graphic::Colormap colormap(k_value + 1);
+  for (int value = 0; value <= k_value; ++value) {
+    if (value == k_value) {
+      colormap[value] = core;
+    } else if (value >= k_value * 0.2) {
+      colormap[value] = inner;
+    } else if (value >= k_value * 0.1) {
+      colormap[value] = outer;
+    }
+  }
+  return colormap;
 }
 
 static constexpr float MARGIN = 4.0f;
 static constexpr float BASE_SPACING = 2000.0f;
 static constexpr size_t SHOW_THRESHOLD = 500000000ULL;
 
-int main() {
+int main(int argc, char **argv) {
+  static int pthread_nums = 80;
+  static int tile_size = 32;
 
+  mandelbrot::BenchOptions options;
+  options.threads = pthread_nums;
+  options.tile = tile_size;
+  bool headless = false;
+  auto kernel = mandelbrot::Kernel::Escape;
+  try {
+    headless = mandelbrot::parse_bench_options(argc, argv, options);
+    // set here, run_bench is not reached when writing a poster
+    mandelbrot::active_isa() = mandelbrot::parse_isa(options.isa);
+    kernel = mandelbrot::parse_kernel(options.kernel);
+  } catch (const std::exception &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+  if (headless) {
+    parallel::ThreadPool pool{options.threads};
+    mandelbrot::AutoK auto_k;
+    mandelbrot::Perturbation perturbation;
+    auto render_view = [&](Square &target, parallel::Tile region) {
+      if (options.deep_zoom()) {
+        // the reference orbit is only computed on the first call
+        perturbation.prepare({options.size, options.deep_x, options.deep_y,
+                              std::pow(10.0, options.zoom)},
+                             options.k_value);
+      }
+      return render(target, {region}, options.size, options.scale,
+                    options.center_x, options.center_y,
+                    {options.k_value, options.tolerance},
+                    pool, options.tile, kernel,
+                    options.auto_k ? &auto_k : nullptr,
+                    options.deep_zoom() ? &perturbation : nullptr);
+    };
+    if (options.output.empty()) {
+      Square canvas(options.size);
+      mandelbrot::run_bench(options, [&] {
+        return render_view(canvas, {0, options.size, 0, options.size});
+      });
+    } else {
+      auto begin = std::chrono::high_resolution_clock::now();
+      mandelbrot::write_poster(
+          options.output, options.size, options.band_rows,
+          tiered_colormap(options.k_value, ImColor(CORE_COLOR),
+                          ImColor(INNER_COLOR), ImColor(OUTER_COLOR)),
+          render_view);
+      auto elapsed = std::chrono::high_resolution_clock::now() - begin;
+      std::cout << "wrote " << options.output << ": " << options.size << 'x'
+                << options.size << " pixels in "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(
+                       elapsed)
+                       .count()
+                << " ms, " << options.band_rows << " rows per band"
+                << std::endl;
+    }
+    pool.report(std::cerr);
+    return 0;
+  }
+
+  parallel::ThreadPool pool{pthread_nums};
   graphic::GraphicContext context{"Assignment 2"};
+  mandelbrot::Painter painter;
   Square canvas(100);
-  size_t duration = 0;
-  size_t pixels = 0;
+  mandelbrot::SpeedMeter meter{SHOW_THRESHOLD};
   context.run([&](graphic::GraphicContext *context [[maybe_unused]],
                   SDL_Window *) {
     {
@@ -87,97 +207,96 @@ int main() {
       ImGui::Begin("Assignment 2", nullptr,
                    ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse |
                        ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
-      ImDrawList *draw_list = ImGui::GetWindowDrawList();
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                   1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
       static int center_x = 0;
       static int center_y = -300; // Why we have to recenter?
       static int size = 800;
       static int scale = 1;
-      static ImVec4 col = ImVec4(1.0f, 1.0f, 1.0f, 1.0f);
+      static ImVec4 col = CORE_COLOR;
       static int k_value = 100;
       ImGui::DragInt("Center X", &center_x, 1, -4 * size, 4 * size, "%d");
       ImGui::DragInt("Center Y", &center_y, 1, -4 * size, 4 * size, "%d");
       ImGui::DragInt("Fineness", &size, 10, 100, 1000, "%d");
       ImGui::DragInt("Scale", &scale, 1, 1, 100, "%.01f");
       ImGui::DragInt("K", &k_value, 1, 100, 1000, "%d");
+      ImGui::DragInt("Tile Size", &tile_size, 1, 1, 256, "%d");
+      static mandelbrot::Kernel kernel = mandelbrot::Kernel::Escape;
+      ImGui::ListBox("Kernel", reinterpret_cast<int *>(&kernel),
+                     mandelbrot::kernel_list, 2);
+      static double tolerance = 0.0;
+      static bool adaptive_k = false;
+      static mandelbrot::AutoK auto_k;
+      ImGui::InputDouble("Periodicity Tolerance", &tolerance, 1e-10, 1e-6,
+                         "%.1e");
+      ImGui::Checkbox("Auto K", &adaptive_k);
+      static bool deep_zoom = false;
+      static char deep_x[128] = "-0.743643887037158704752191506114774";
+      static char deep_y[128] = "0.131825904205311970493132056385139";
+      static float zoom_digits = 0.0f;
+      ImGui::Checkbox("Deep Zoom", &deep_zoom);
+      if (deep_zoom) {
+        ImGui::InputText("Deep Center X", deep_x, sizeof(deep_x));
+        ImGui::InputText("Deep Center Y", deep_y, sizeof(deep_y));
+        ImGui::DragFloat("Zoom (log10)", &zoom_digits, 0.05f, 0.0f,
+                         mandelbrot::MAX_ZOOM_DIGITS, "%.2f");
+      }
       ImGui::ColorEdit4("Color", &col.x);
       {
-        using namespace std::chrono;
         auto spacing = BASE_SPACING / static_cast<float>(size);
-        auto radius = spacing / 2;
         const ImVec2 p = ImGui::GetCursorScreenPos();
-        const ImU32 col32 = ImColor(col);
-        float x = p.x + MARGIN, y = p.y + MARGIN;
-        canvas.resize(size);
-        auto begin = high_resolution_clock::now();
-
-        // parallel part
-        static int pthread_nums = 80;
-        pthread_mutex_t mutexJob;
-        int task_remain = size - pthread_nums;
-        std::vector<struct Pthread_Arg> argp(pthread_nums);
-        std::vector<pthread_t> tids(pthread_nums);
-
-        // create child pthreads
-        for (int i = 0; i < pthread_nums; ++i) {
-          // Initialize arguments for the parallel function
-          argp[i].buffer = &canvas;
-          argp[i].start_index = size - i - 1;
-          argp[i].size = size;
-          argp[i].task_remain = &task_remain;
-          argp[i].lock = &mutexJob;
-          argp[i].scale = scale;
-          argp[i].k_value = k_value;
-          argp[i].x_center = center_x;
-          argp[i].y_center = center_y;
-
-          pthread_attr_t attr;
-          pthread_attr_init(&attr);
-          pthread_create(&tids[i], &attr, mandelbrotPThreadCal, &argp[i]);
+        static mandelbrot::FrameCache cache;
+        static mandelbrot::Perturbation perturbation;
+        static std::string deep_key;
+        static std::vector<parallel::Tile> deep_regions;
+        deep_regions.clear();
+        if (deep_zoom) {
+          // a deep frame is recomputed as a whole whenever its view changes
+          auto key = std::string{deep_x} + ' ' + deep_y + ' ' +
+                     std::to_string(zoom_digits) + ' ' +
+                     std::to_string(size) + ' ' + std::to_string(k_value);
+          if (key != deep_key) {
+            try {
+              perturbation.prepare({size, deep_x, deep_y,
+                                    std::pow(10.0, zoom_digits)},
+                                   k_value);
+              canvas.resize(size);
+              deep_regions.push_back({0, size, 0, size});
+              deep_key = key;
+            } catch (const std::runtime_error &) {
+              // keep the last frame while the center is being typed
+            }
+          }
+          cache.invalidate();
+        } else {
+          deep_key.clear();
         }
-        // Join all child threads
-        for (int i = 0; i < pthread_nums; ++i) {
-          pthread_join(tids[i], NULL);
+        auto &regions =
+            deep_zoom
+                ? deep_regions
+                : cache.update(canvas,
+                               {size, scale, static_cast<double>(center_x),
+                                static_cast<double>(center_y), k_value,
+                                tolerance, kernel, adaptive_k});
+        if (!regions.empty()) {
+          meter.measure(mandelbrot::region_pixels(regions), [&] {
+            return render(canvas, regions, size, scale, center_x, center_y,
+                          {k_value, tolerance}, pool, tile_size, kernel,
+                          adaptive_k ? &auto_k : nullptr,
+                          deep_zoom ? &perturbation : nullptr);
+          });
         }
-
-        auto end = high_resolution_clock::now();
-        pixels += size;
-        duration += duration_cast<nanoseconds>(end - begin).count();
-        if (duration > SHOW_THRESHOLD) {
-          std::cout << pixels << " pixels in last " << duration
-                    << " nanoseconds\n";
-          auto speed =
-              static_cast<double>(pixels) / static_cast<double>(duration) * 1e9;
-          std::cout << "speed: " << speed << " pixels per second" << std::endl;
-          pixels = 0;
-          duration = 0;
+        if (meter.ready()) {
+          meter.report(std::cout);
+          pool.report(std::cout);
         }
 
-        static ImVec4 col_2 = ImVec4(0.6f, 0.2f, 1.0f, 1.0f);
-        static ImVec4 col_3 = ImVec4(0.1f, 0.1f, 0.8f, 1.0f);
-        const ImU32 col16 = ImColor(col_2);
-        const ImU32 col8 = ImColor(col_3);
-
-        for (int i = 0; i < size; ++i) {
-          for (int j = 0; j < size; ++j) {
-
-            if (canvas[{i, j}] == k_value) {
-              draw_list->AddCircleFilled(ImVec2(x, y), radius, col32);
-            } // core
-
-            else if (canvas[{i, j}] >= k_value * 0.2) {
-              draw_list->AddCircleFilled(ImVec2(x, y), radius, col16);
-            } // inner
-
-            else if (canvas[{i, j}] >= k_value * 0.1) {
-              draw_list->AddCircleFilled(ImVec2(x, y), radius, col8);
-            } // outer
-            x += spacing;
-          }
-          y += spacing;
-          x = p.x + MARGIN;
-        }
+        static ImVec4 col_2 = INNER_COLOR;
+        static ImVec4 col_3 = OUTER_COLOR;
+        auto colormap = tiered_colormap(k_value, ImColor(col), ImColor(col_2),
+                                        ImColor(col_3));
+        painter.draw(canvas, colormap, ImVec2(p.x + MARGIN, p.y + MARGIN),
+                     spacing * static_cast<float>(size));
       }
       ImGui::End();
     }
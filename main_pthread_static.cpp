@@ -1,76 +1,193 @@
 #include <chrono>
-#include <complex>
+#include <cmath>
 #include <cstring>
+#include <graphic/colormap.hpp>
 #include <graphic/graphic.hpp>
 #include <imgui_impl_sdl.h>
 #include <iostream>
+#include <mandelbrot/auto_k.hpp>
+#include <mandelbrot/bench.hpp>
+#include <mandelbrot/canvas.hpp>
+#include <mandelbrot/frame_cache.hpp>
+#include <mandelbrot/kernel.hpp>
+#include <mandelbrot/painter.hpp>
+#include <mandelbrot/perturbation.hpp>
+#include <mandelbrot/poster.hpp>
+#include <mandelbrot/render.hpp>
+#include <parallel/partition.hpp>
+#include <parallel/thread_pool.hpp>
 #include <pthread.h>
+#include <string>
 #include <vector>
 
-struct Square {
-  std::vector<int> buffer;
-  size_t length;
-
-  explicit Square(size_t length) : buffer(length), length(length * length) {}
-
-  void resize(size_t new_length) {
-    buffer.assign(new_length * new_length, false);
-    length = new_length;
-  }
-
-  auto &operator[](std::pair<size_t, size_t> pos) {
-    return buffer[pos.second * length + pos.first];
-  }
-};
+using Square = mandelbrot::Square<>;
 
 struct Pthread_Arg {
-  struct Square *buffer;
-  int start_index;
-  int size, sub_size;
+  Square *buffer;
+  int worker;
+  const parallel::Partition *partition;
+  int size;
   int scale, k_value;
+  double tolerance;
   double x_center, y_center;
+  mandelbrot::Kernel kernel;
+  mandelbrot::AutoK *auto_k;
+  const mandelbrot::Perturbation *perturbation;
+  uint64_t saved;
 };
 
 void *mandelbrotPThreadCal(void *argp) {
   struct Pthread_Arg *args = (struct Pthread_Arg *)argp;
 
-  double cx = static_cast<double>(args->size) / 2 + args->x_center;
-  double cy = static_cast<double>(args->size) / 2 + args->y_center;
-  double zoom_factor = static_cast<double>(args->size) / 4 * args->scale;
+  mandelbrot::View view{args->size, args->scale, args->x_center,
+                        args->y_center};
+  std::vector<int> row(args->size);
 
-  // only loop through the subsection assigned
+  // only loop through the tiles assigned
   // no need for locking
+  args->saved = 0;
+  args->partition->for_each_tile(args->worker, [&](parallel::Tile tile) {
+    if (args->perturbation) {
+      args->saved += mandelbrot::render_tile(*(args->buffer), tile,
+                                             *args->perturbation, row);
+    } else {
+      args->saved += mandelbrot::render_tile(*(args->buffer), tile, view,
+                                             {args->k_value, args->tolerance},
+                                             args->kernel, row, args->auto_k);
+    }
+  });
 
-  // TODO: cut canvas in chunks and do dynamic scheduling
-  for (int i = args->start_index; i < args->sub_size; ++i) {
-    for (int j = 0; j < args->size; ++j) {
-      double x = (static_cast<double>(j) - cx) / zoom_factor;
-      double y = (static_cast<double>(i) - cy) / zoom_factor;
-      std::complex<double> z{0, 0};
-      std::complex<double> c{x, y};
-      int k = 0;
-      do {
-        z = z * z + c;
-        k++;
-      } while (norm(z) < 2.0 && k < args->k_value);
+  return nullptr;
+}
+
+// compute the pixels of `regions`, each split among the threads by `partition`
+uint64_t render(Square &canvas, const std::vector<parallel::Tile> &regions,
+                int size, int scale, double x_center, double y_center,
+                mandelbrot::Budget budget, parallel::ThreadPool &pool,
+                parallel::Partition partition, mandelbrot::Kernel kernel,
+                mandelbrot::AutoK *auto_k,
+                const mandelbrot::Perturbation *perturbation = nullptr) {
+  int pthread_nums = pool.size();
+  partition.workers = pthread_nums;
+  std::vector<struct Pthread_Arg> argp(pthread_nums);
+  if (perturbation) {
+    // perturbed rows never report their escape times to the caps
+    auto_k = nullptr;
+  }
+  if (auto_k) {
+    auto_k->begin_frame(size, budget.k_value);
+  }
 
-      (*(args->buffer))[{i, j}] = k;
+  for (int i = 0; i < pthread_nums; ++i) {
+    // Initialize arguments for the parallel function
+    argp[i].buffer = &canvas;
+    argp[i].worker = i;
+    argp[i].partition = &partition;
+    argp[i].size = size;
+    argp[i].scale = scale;
+    argp[i].k_value = budget.k_value;
+    argp[i].tolerance = budget.tolerance;
+    argp[i].x_center = x_center;
+    argp[i].y_center = y_center;
+    argp[i].kernel = kernel;
+    argp[i].auto_k = auto_k;
+    argp[i].perturbation = perturbation;
+  }
+  uint64_t saved = 0;
+  for (const auto &region : regions) {
+    partition.cover(region);
+    pool.run([&](int worker) { mandelbrotPThreadCal(&argp[worker]); });
+    for (const auto &arg : argp) {
+      saved += arg.saved;
     }
   }
+  if (auto_k) {
+    auto_k->end_frame();
+  }
+  return saved;
+}
+
+static const ImVec4 CORE_COLOR = ImVec4(1.0f, 1.0f, 0.4f, 1.0f);
 
-  pthread_exit(0);
+// points of the set take `core`, everything else stays black
+graphic::Colormap core_colormap(int k_value, ImU32 core) {
+  graphic::Colormap colormap(k_value + 1);
+  colormap[k_value] = core;
+  return colormap;
 }
 
 static constexpr float MARGIN = 4.0f;
 static constexpr float BASE_SPACING = 2000.0f;
 static constexpr size_t SHOW_THRESHOLD = 500000000ULL;
 
-int main() {
+int main(int argc, char **argv) {
+  static int pthread_nums = 8;
 
+  mandelbrot::BenchOptions options;
+  options.threads = pthread_nums;
+  bool headless = false;
+  auto kernel = mandelbrot::Kernel::Escape;
+  parallel::Partition partition;
+  try {
+    headless = mandelbrot::parse_bench_options(argc, argv, options);
+    // set here, run_bench is not reached when writing a poster
+    mandelbrot::active_isa() = mandelbrot::parse_isa(options.isa);
+    kernel = mandelbrot::parse_kernel(options.kernel);
+    partition.distribution =
+        parallel::parse_distribution(options.distribution);
+  } catch (const std::exception &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+  if (headless) {
+    parallel::ThreadPool pool{options.threads};
+    partition.tile_rows = options.tile_rows;
+    partition.tile_cols = options.tile_cols;
+    partition.block = options.block;
+    mandelbrot::AutoK auto_k;
+    mandelbrot::Perturbation perturbation;
+    auto render_view = [&](Square &target, parallel::Tile region) {
+      if (options.deep_zoom()) {
+        // the reference orbit is only computed on the first call
+        perturbation.prepare({options.size, options.deep_x, options.deep_y,
+                              std::pow(10.0, options.zoom)},
+                             options.k_value);
+      }
+      return render(target, {region}, options.size, options.scale,
+                    options.center_x, options.center_y,
+                    {options.k_value, options.tolerance},
+                    pool, partition, kernel,
+                    options.auto_k ? &auto_k : nullptr,
+                    options.deep_zoom() ? &perturbation : nullptr);
+    };
+    if (options.output.empty()) {
+      Square canvas(options.size);
+      mandelbrot::run_bench(options, [&] {
+        return render_view(canvas, {0, options.size, 0, options.size});
+      });
+    } else {
+      auto begin = std::chrono::high_resolution_clock::now();
+      mandelbrot::write_poster(
+          options.output, options.size, options.band_rows,
+          core_colormap(options.k_value, ImColor(CORE_COLOR)), render_view);
+      auto elapsed = std::chrono::high_resolution_clock::now() - begin;
+      std::cout << "wrote " << options.output << ": " << options.size << 'x'
+                << options.size << " pixels in "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(
+                       elapsed)
+                       .count()
+                << " ms, " << options.band_rows << " rows per band"
+                << std::endl;
+    }
+    pool.report(std::cerr);
+    return 0;
+  }
+
+  parallel::ThreadPool pool{pthread_nums};
   graphic::GraphicContext context{"Assignment 2"};
+  mandelbrot::Painter painter;
   Square canvas(100);
-  size_t duration = 0;
-  size_t pixels = 0;
+  mandelbrot::SpeedMeter meter{SHOW_THRESHOLD};
   context.run([&](graphic::GraphicContext *context [[maybe_unused]],
                   SDL_Window *) {
     {
@@ -80,14 +197,13 @@ int main() {
       ImGui::Begin("Assignment 2", nullptr,
                    ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse |
                        ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
-      ImDrawList *draw_list = ImGui::GetWindowDrawList();
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                   1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
       static int center_x = 0;
       static int center_y = -300; // Why we have to recenter?
       static int size = 800;
       static int scale = 1;
-      static ImVec4 col = ImVec4(1.0f, 1.0f, 0.4f, 1.0f);
+      static ImVec4 col = CORE_COLOR;
       static ImVec4 col_2 = ImVec4(0, 0, 0, 1.0f);
       static int k_value = 100;
       ImGui::DragInt("Center X", &center_x, 1, -4 * size, 4 * size, "%d");
@@ -96,69 +212,87 @@ int main() {
       ImGui::DragInt("Scale", &scale, 1, 1, 100, "%.01f");
       ImGui::DragInt("K", &k_value, 1, 100, 1000, "%d");
       ImGui::ColorEdit4("Color", &col.x);
+      static parallel::Partition partition;
+      ImGui::ListBox("Distribution",
+                     reinterpret_cast<int *>(&partition.distribution),
+                     parallel::distribution_list, 3);
+      ImGui::DragInt("Tile Height", &partition.tile_rows, 1, 1, 256, "%d");
+      ImGui::DragInt("Tile Width (0 = row)", &partition.tile_cols, 1, 0, 1000,
+                     "%d");
+      ImGui::DragInt("Cyclic Block", &partition.block, 1, 1, 256, "%d");
+      static mandelbrot::Kernel kernel = mandelbrot::Kernel::Escape;
+      ImGui::ListBox("Kernel", reinterpret_cast<int *>(&kernel),
+                     mandelbrot::kernel_list, 2);
+      static double tolerance = 0.0;
+      static bool adaptive_k = false;
+      static mandelbrot::AutoK auto_k;
+      ImGui::InputDouble("Periodicity Tolerance", &tolerance, 1e-10, 1e-6,
+                         "%.1e");
+      ImGui::Checkbox("Auto K", &adaptive_k);
+      static bool deep_zoom = false;
+      static char deep_x[128] = "-0.743643887037158704752191506114774";
+      static char deep_y[128] = "0.131825904205311970493132056385139";
+      static float zoom_digits = 0.0f;
+      ImGui::Checkbox("Deep Zoom", &deep_zoom);
+      if (deep_zoom) {
+        ImGui::InputText("Deep Center X", deep_x, sizeof(deep_x));
+        ImGui::InputText("Deep Center Y", deep_y, sizeof(deep_y));
+        ImGui::DragFloat("Zoom (log10)", &zoom_digits, 0.05f, 0.0f,
+                         mandelbrot::MAX_ZOOM_DIGITS, "%.2f");
+      }
       {
-        using namespace std::chrono;
         auto spacing = BASE_SPACING / static_cast<float>(size);
-        auto radius = spacing / 2;
         const ImVec2 p = ImGui::GetCursorScreenPos();
-        const ImU32 col32 = ImColor(col);
-        // const ImU32 col16 = ImColor(col_2);
-        float x = p.x + MARGIN, y = p.y + MARGIN;
-        canvas.resize(size);
-        auto begin = high_resolution_clock::now();
-
-        // parallel part
-        static int pthread_nums = 8;
-        std::vector<struct Pthread_Arg> argp(pthread_nums);
-        std::vector<pthread_t> tids(pthread_nums);
-
-        // create child pthreads
-        for (int i = 0; i < pthread_nums; ++i) {
-          // Initialize arguments for the parallel function
-          argp[i].buffer = &canvas;
-          argp[i].start_index = i * size / pthread_nums;
-          argp[i].size = size;
-          argp[i].sub_size = size / pthread_nums;
-          argp[i].scale = scale;
-          argp[i].k_value = k_value;
-          argp[i].x_center = center_x;
-          argp[i].y_center = center_y;
-
-          pthread_attr_t attr;
-          pthread_attr_init(&attr);
-          pthread_create(&tids[i], &attr, mandelbrotPThreadCal, &argp[i]);
-        }
-        // Join all child threads
-        for (int i = 0; i < pthread_nums; ++i) {
-          pthread_join(tids[i], NULL);
-        }
-
-        auto end = high_resolution_clock::now();
-        pixels += size;
-        duration += duration_cast<nanoseconds>(end - begin).count();
-        if (duration > SHOW_THRESHOLD) {
-          std::cout << pixels << " pixels in last " << duration
-                    << " nanoseconds\n";
-          auto speed =
-              static_cast<double>(pixels) / static_cast<double>(duration) * 1e9;
-          std::cout << "speed: " << speed << " pixels per second" << std::endl;
-          pixels = 0;
-          duration = 0;
-        }
-        for (int i = 0; i < size; ++i) {
-          for (int j = 0; j < size; ++j) {
-            if (canvas[{i, j}] == k_value) {
-              draw_list->AddCircleFilled(ImVec2(x, y), radius, col32);
+        auto colormap = core_colormap(k_value, ImColor(col));
+        // test of coloring
+        // colormap[k_value / 2] = ImColor(col_2);
+        static mandelbrot::FrameCache cache;
+        static mandelbrot::Perturbation perturbation;
+        static std::string deep_key;
+        static std::vector<parallel::Tile> deep_regions;
+        deep_regions.clear();
+        if (deep_zoom) {
+          // a deep frame is recomputed as a whole whenever its view changes
+          auto key = std::string{deep_x} + ' ' + deep_y + ' ' +
+                     std::to_string(zoom_digits) + ' ' +
+                     std::to_string(size) + ' ' + std::to_string(k_value);
+          if (key != deep_key) {
+            try {
+              perturbation.prepare({size, deep_x, deep_y,
+                                    std::pow(10.0, zoom_digits)},
+                                   k_value);
+              canvas.resize(size);
+              deep_regions.push_back({0, size, 0, size});
+              deep_key = key;
+            } catch (const std::runtime_error &) {
+              // keep the last frame while the center is being typed
             }
-            // test of coloring
-            // if (canvas[{i, j}] == k_value / 2) {
-            //   draw_list->AddCircleFilled(ImVec2(x, y), radius, col16);
-            // }
-            x += spacing;
           }
-          y += spacing;
-          x = p.x + MARGIN;
+          cache.invalidate();
+        } else {
+          deep_key.clear();
+        }
+        auto &regions =
+            deep_zoom
+                ? deep_regions
+                : cache.update(canvas,
+                               {size, scale, static_cast<double>(center_x),
+                                static_cast<double>(center_y), k_value,
+                                tolerance, kernel, adaptive_k});
+        if (!regions.empty()) {
+          meter.measure(mandelbrot::region_pixels(regions), [&] {
+            return render(canvas, regions, size, scale, center_x, center_y,
+                          {k_value, tolerance}, pool, partition, kernel,
+                          adaptive_k ? &auto_k : nullptr,
+                          deep_zoom ? &perturbation : nullptr);
+          });
+        }
+        if (meter.ready()) {
+          meter.report(std::cout);
+          pool.report(std::cout);
         }
+        painter.draw(canvas, colormap, ImVec2(p.x + MARGIN, p.y + MARGIN),
+                     spacing * static_cast<float>(size));
       }
       ImGui::End();
     }
@@ -1,47 +1,268 @@
+#include <algorithm>
 #include <chrono>
-#include <complex>
+#include <cstdint>
 #include <cstring>
+#include <graphic/colormap.hpp>
 #include <graphic/graphic.hpp>
 #include <imgui_impl_sdl.h>
 #include <iostream>
+#include <mandelbrot/bench.hpp>
+#include <mandelbrot/canvas.hpp>
+#include <mandelbrot/frame_cache.hpp>
+#include <mandelbrot/kernel.hpp>
+#include <mandelbrot/painter.hpp>
+#include <mandelbrot/poster.hpp>
+#include <mandelbrot/render.hpp>
 #include <mpi.h>
+#include <parallel/work_stealing.hpp>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
-struct Square {
-  std::vector<int> buffer;
-  size_t length;
+using Square = mandelbrot::Square<>;
 
-  explicit Square(size_t length) : buffer(length), length(length * length) {}
+uint64_t calculate(Square &buffer, const std::vector<parallel::Tile> &regions,
+                   int size, int scale, double x_center, double y_center,
+                   mandelbrot::Budget budget) {
+  mandelbrot::View view{size, scale, x_center, y_center};
+  std::vector<int> row(size);
+  uint64_t saved = 0;
+  for (const auto &region : regions) {
+    for (int i = region.row_begin; i < region.row_end; ++i) {
+      saved += mandelbrot::escape_row(row.data(), i, region.col_begin,
+                                      region.col_end, view, budget);
+      for (int j = region.col_begin; j < region.col_end; ++j) {
+        buffer[{i, j}] = row[j - region.col_begin];
+      }
+    }
+  }
+  return saved;
+}
+
+// Master/worker protocol: rank 0 hands out blocks of rows, restricted to a
+// range of columns, as Tasks and the workers answer with the escape times of
+// the block, row by row, followed by the iterations the periodicity check
+// saved on the block.
+static constexpr int TASK_TAG = 0;
+static constexpr int RESULT_TAG = 1;
+// tasks kept in flight per worker, so a worker never waits for its next block
+static constexpr int TASK_DEPTH = 2;
+
+struct Task {
+  int size, scale, k_value;
+  int row_begin, row_end; // row_begin < 0 asks the worker to stop
+  int col_begin, col_end;
+  double x_center, y_center;
+  double tolerance;
+};
+
+// ints appended to a result slice to carry its uint64_t saved iterations
+static constexpr size_t SAVED_INTS = sizeof(uint64_t) / sizeof(int);
+
+void mpiWorker() {
+  Task task;
+  std::vector<int> slices[TASK_DEPTH];
+  MPI_Request sends[TASK_DEPTH] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  for (int current = 0;; current = (current + 1) % TASK_DEPTH) {
+    MPI_Recv(&task, sizeof(Task), MPI_BYTE, 0, TASK_TAG, MPI_COMM_WORLD,
+             MPI_STATUS_IGNORE);
+    if (task.row_begin < 0) {
+      break;
+    }
+    // the slice may still be on its way to rank 0
+    MPI_Wait(&sends[current], MPI_STATUS_IGNORE);
+    auto &slice = slices[current];
+    auto width = task.col_end - task.col_begin;
+    auto pixels = static_cast<size_t>(task.row_end - task.row_begin) * width;
+    slice.resize(pixels + SAVED_INTS);
+    mandelbrot::View view{task.size, task.scale, task.x_center,
+                          task.y_center};
+    uint64_t saved = 0;
+    for (int i = task.row_begin; i < task.row_end; ++i) {
+      saved += mandelbrot::escape_row(
+          &slice[static_cast<size_t>(i - task.row_begin) * width], i,
+          task.col_begin, task.col_end, view, {task.k_value, task.tolerance});
+    }
+    std::memcpy(&slice[pixels], &saved, sizeof(saved));
+    MPI_Isend(slice.data(), static_cast<int>(slice.size()), MPI_INT, 0,
+              RESULT_TAG, MPI_COMM_WORLD, &sends[current]);
+  }
+  MPI_Waitall(TASK_DEPTH, sends, MPI_STATUSES_IGNORE);
+}
 
-  void resize(size_t new_length) {
-    buffer.assign(new_length * new_length, false);
-    length = new_length;
+// Dynamic scheduling on rank 0: every worker keeps TASK_DEPTH blocks in
+// flight, and whichever result arrives first is answered with the next block.
+// Blocks are cut from `regions` one after another.
+uint64_t mpiCalculate(Square &canvas,
+                      const std::vector<parallel::Tile> &regions, int size,
+                      int scale, double x_center, double y_center,
+                      mandelbrot::Budget budget, int block_rows) {
+  int world_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  if (world_size == 1) {
+    return calculate(canvas, regions, size, scale, x_center, y_center,
+                     budget);
   }
 
-  auto &operator[](std::pair<size_t, size_t> pos) {
-    return buffer[pos.second * length + pos.first];
+  struct Slot {
+    Task task;
+    int worker;
+    std::vector<int> slice;
+  };
+  auto slot_count = static_cast<size_t>(world_size - 1) * TASK_DEPTH;
+  std::vector<Slot> slots(slot_count);
+  std::vector<MPI_Request> sends(slot_count, MPI_REQUEST_NULL);
+  std::vector<MPI_Request> recvs(slot_count, MPI_REQUEST_NULL);
+  size_t next_region = 0;
+  int next_row = regions.empty() ? 0 : regions[0].row_begin;
+  uint64_t saved = 0;
+  // move on to the next non-empty region once the current one is handed out
+  auto advance = [&] {
+    while (next_region < regions.size() &&
+           next_row >= regions[next_region].row_end) {
+      if (++next_region < regions.size()) {
+        next_row = regions[next_region].row_begin;
+      }
+    }
+  };
+  advance();
+  auto pending = [&] { return next_region < regions.size(); };
+
+  auto dispatch = [&](size_t index) {
+    auto &slot = slots[index];
+    MPI_Wait(&sends[index], MPI_STATUS_IGNORE);
+    const auto &region = regions[next_region];
+    slot.task = {size,
+                 scale,
+                 budget.k_value,
+                 next_row,
+                 std::min(next_row + block_rows, region.row_end),
+                 region.col_begin,
+                 region.col_end,
+                 x_center,
+                 y_center,
+                 budget.tolerance};
+    next_row = slot.task.row_end;
+    advance();
+    slot.slice.resize(static_cast<size_t>(slot.task.row_end -
+                                          slot.task.row_begin) *
+                          (region.col_end - region.col_begin) +
+                      SAVED_INTS);
+    // receives from one worker match in posting order, which is the order
+    // the worker answers its tasks in
+    MPI_Irecv(slot.slice.data(), static_cast<int>(slot.slice.size()), MPI_INT,
+              slot.worker, RESULT_TAG, MPI_COMM_WORLD, &recvs[index]);
+    MPI_Isend(&slot.task, sizeof(Task), MPI_BYTE, slot.worker, TASK_TAG,
+              MPI_COMM_WORLD, &sends[index]);
+  };
+
+  for (int depth = 0; depth < TASK_DEPTH; ++depth) {
+    for (int worker = 1; worker < world_size; ++worker) {
+      auto index = static_cast<size_t>(worker - 1) * TASK_DEPTH + depth;
+      slots[index].worker = worker;
+      if (pending()) {
+        dispatch(index);
+      }
+    }
   }
-};
 
-void calculate(Square &buffer, int size, int scale, double x_center,
-               double y_center, int k_value) {
-  double cx = static_cast<double>(size) / 2 + x_center;
-  double cy = static_cast<double>(size) / 2 + y_center;
-  double zoom_factor = static_cast<double>(size) / 4 * scale;
-  for (int i = 0; i < size; ++i) {
-    for (int j = 0; j < size; ++j) {
-      double x = (static_cast<double>(j) - cx) / zoom_factor;
-      double y = (static_cast<double>(i) - cy) / zoom_factor;
-      std::complex<double> z{0, 0};
-      std::complex<double> c{x, y};
-      int k = 0;
-      do {
-        z = z * z + c;
-        k++;
-      } while (norm(z) < 2.0 && k < k_value);
-      buffer[{i, j}] = k;
+  while (true) {
+    int index;
+    MPI_Waitany(static_cast<int>(slot_count), recvs.data(), &index,
+                MPI_STATUS_IGNORE);
+    if (index == MPI_UNDEFINED) {
+      break;
+    }
+    auto &slot = slots[index];
+    auto width = slot.task.col_end - slot.task.col_begin;
+    for (int i = slot.task.row_begin; i < slot.task.row_end; ++i) {
+      for (int j = slot.task.col_begin; j < slot.task.col_end; ++j) {
+        canvas[{i, j}] =
+            slot.slice[static_cast<size_t>(i - slot.task.row_begin) * width +
+                       (j - slot.task.col_begin)];
+      }
+    }
+    uint64_t block_saved;
+    std::memcpy(&block_saved, &slot.slice[slot.slice.size() - SAVED_INTS],
+                sizeof(block_saved));
+    saved += block_saved;
+    if (pending()) {
+      dispatch(index);
     }
   }
+  MPI_Waitall(static_cast<int>(slot_count), sends.data(),
+              MPI_STATUSES_IGNORE);
+  return saved;
+}
+
+void stopWorkers() {
+  int world_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  Task stop{};
+  stop.row_begin = -1;
+  for (int worker = 1; worker < world_size; ++worker) {
+    MPI_Send(&stop, sizeof(Task), MPI_BYTE, worker, TASK_TAG, MPI_COMM_WORLD);
+  }
+}
+
+// Every rank renders the bands b with b % world_size == rank on its own and
+// writes them at their place in the shared PPM file through MPI-IO. The file
+// regions of the ranks are disjoint, so no pixel ever goes through rank 0.
+// Collective; returns the iterations saved by all ranks on rank 0.
+uint64_t mpiWritePoster(const mandelbrot::BenchOptions &options,
+                        const graphic::Colormap &colormap) {
+  int rank, world_size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  auto size = static_cast<size_t>(options.size);
+  MPI_File file;
+  if (MPI_SUCCESS != MPI_File_open(MPI_COMM_WORLD, options.output.c_str(),
+                                   MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                                   MPI_INFO_NULL, &file)) {
+    throw std::runtime_error("cannot open " + options.output);
+  }
+  // also cuts off whatever a larger old file had past the image
+  MPI_File_set_size(file, static_cast<MPI_Offset>(
+                              graphic::PpmFile::file_size(size, size)));
+  if (0 == rank) {
+    auto header = graphic::PpmFile::header(size, size);
+    MPI_File_write_at(file, 0, header.data(), static_cast<int>(header.size()),
+                      MPI_CHAR, MPI_STATUS_IGNORE);
+  }
+  mandelbrot::View view{options.size, options.scale,
+                        static_cast<double>(options.center_x),
+                        static_cast<double>(options.center_y)};
+  auto kernel = mandelbrot::parse_kernel(options.kernel);
+  mandelbrot::PosterBand band;
+  std::vector<int> scratch;
+  uint64_t saved = 0;
+  for (int first = rank * options.band_rows; first < options.size;
+       first += world_size * options.band_rows) {
+    auto rows = std::min(options.band_rows, options.size - first);
+    auto region = band.reshape(options.size, first, rows);
+    saved += mandelbrot::render_tile(band.canvas, region, view,
+                                     {options.k_value, options.tolerance},
+                                     kernel, scratch);
+    auto offset = graphic::PpmFile::row_offset(size, size,
+                                               static_cast<size_t>(first));
+    auto rgb = band.color(colormap);
+    MPI_File_write_at(file, static_cast<MPI_Offset>(offset), rgb,
+                      static_cast<int>(band.rgb.size()), MPI_BYTE,
+                      MPI_STATUS_IGNORE);
+  }
+  MPI_File_close(&file);
+  uint64_t total = 0;
+  MPI_Reduce(&saved, &total, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+  return total;
+}
+
+static const ImVec4 CORE_COLOR = ImVec4(1.0f, 1.0f, 0.4f, 1.0f);
+
+// points of the set take `core`, everything else stays black
+graphic::Colormap core_colormap(int k_value, ImU32 core) {
+  graphic::Colormap colormap(k_value + 1);
+  colormap[k_value] = core;
+  return colormap;
 }
 
 static constexpr float MARGIN = 4.0f;
@@ -49,14 +270,75 @@ static constexpr float BASE_SPACING = 2000.0f;
 static constexpr size_t SHOW_THRESHOLD = 500000000ULL;
 
 int main(int argc, char **argv) {
-  int rank;
+  int rank, world_size;
   MPI_Init(&argc, &argv);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  if (0 == rank) {
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  static int block_rows = 4;
+  mandelbrot::BenchOptions options;
+  options.block = block_rows;
+  bool headless = false;
+  try {
+    // every rank reads the options, since all of them write a poster
+    headless = mandelbrot::parse_bench_options(argc, argv, options);
+    // the workers render with it too, not only rank 0 in run_bench
+    mandelbrot::active_isa() = mandelbrot::parse_isa(options.isa);
+    // the master/worker protocol only carries escape time rows
+    if (headless && options.output.empty() &&
+        mandelbrot::parse_kernel(options.kernel) !=
+            mandelbrot::Kernel::Escape) {
+      throw std::runtime_error("--kernel " + options.kernel +
+                               " is only supported with --output\n" +
+                               mandelbrot::bench_usage());
+    }
+    // the workers iterate every row up to k; there are no adaptive caps
+    if (headless && options.auto_k != 0) {
+      throw std::runtime_error(
+          std::string{"--auto-k is not supported by the MPI front end\n"} +
+          mandelbrot::bench_usage());
+    }
+    // deep zoom is only rendered by the pthread front ends
+    if (headless && (options.deep_zoom() || options.zoom != 0.0)) {
+      throw std::runtime_error(
+          std::string{"--deep-x, --deep-y and --zoom are not supported by "
+                      "the MPI front end\n"} +
+          mandelbrot::bench_usage());
+    }
+  } catch (const std::exception &error) {
+    if (0 == rank) {
+      std::cerr << error.what() << std::endl;
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  if (headless && !options.output.empty()) {
+    auto begin = MPI_Wtime();
+    auto saved = mpiWritePoster(
+        options, core_colormap(options.k_value, ImColor(CORE_COLOR)));
+    if (0 == rank) {
+      std::cout << "wrote " << options.output << ": " << options.size << 'x'
+                << options.size << " pixels in "
+                << static_cast<long>((MPI_Wtime() - begin) * 1000) << " ms, "
+                << options.band_rows << " rows per band, " << world_size
+                << " ranks, iterations saved: " << saved << std::endl;
+    }
+  } else if (0 != rank) {
+    mpiWorker();
+  } else if (headless) {
+    Square canvas(options.size);
+    options.threads = world_size;
+    mandelbrot::run_bench(options, [&] {
+      return mpiCalculate(canvas, {{0, options.size, 0, options.size}},
+                          options.size, options.scale, options.center_x,
+                          options.center_y,
+                          {options.k_value, options.tolerance}, options.block);
+    });
+    stopWorkers();
+  } else {
     graphic::GraphicContext context{"Assignment 2"};
+    mandelbrot::Painter painter;
     Square canvas(100);
-    size_t duration = 0;
-    size_t pixels = 0;
+    mandelbrot::SpeedMeter meter{SHOW_THRESHOLD};
     context.run(
         [&](graphic::GraphicContext *context [[maybe_unused]], SDL_Window *) {
           {
@@ -67,7 +349,6 @@ int main(int argc, char **argv) {
                          ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse |
                              ImGuiWindowFlags_NoTitleBar |
                              ImGuiWindowFlags_NoResize);
-            ImDrawList *draw_list = ImGui::GetWindowDrawList();
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                         1000.0f / ImGui::GetIO().Framerate,
                         ImGui::GetIO().Framerate);
@@ -75,51 +356,45 @@ int main(int argc, char **argv) {
             static int center_y = 0;
             static int size = 800;
             static int scale = 1;
-            static ImVec4 col = ImVec4(1.0f, 1.0f, 0.4f, 1.0f);
+            static ImVec4 col = CORE_COLOR;
             static int k_value = 100;
             ImGui::DragInt("Center X", &center_x, 1, -4 * size, 4 * size, "%d");
             ImGui::DragInt("Center Y", &center_y, 1, -4 * size, 4 * size, "%d");
             ImGui::DragInt("Fineness", &size, 10, 100, 1000, "%d");
             ImGui::DragInt("Scale", &scale, 1, 1, 100, "%.01f");
             ImGui::DragInt("K", &k_value, 1, 100, 1000, "%d");
+            ImGui::DragInt("Rows per Task", &block_rows, 1, 1, 100, "%d");
+            static double tolerance = 0.0;
+            ImGui::InputDouble("Periodicity Tolerance", &tolerance, 1e-10,
+                               1e-6, "%.1e");
             ImGui::ColorEdit4("Color", &col.x);
             {
-              using namespace std::chrono;
               auto spacing = BASE_SPACING / static_cast<float>(size);
-              auto radius = spacing / 2;
               const ImVec2 p = ImGui::GetCursorScreenPos();
-              const ImU32 col32 = ImColor(col);
-              float x = p.x + MARGIN, y = p.y + MARGIN;
-              canvas.resize(size);
-              auto begin = high_resolution_clock::now();
-              calculate(canvas, size, scale, center_x, center_y, k_value);
-              auto end = high_resolution_clock::now();
-              pixels += size;
-              duration += duration_cast<nanoseconds>(end - begin).count();
-              if (duration > SHOW_THRESHOLD) {
-                std::cout << pixels << " pixels in last " << duration
-                          << " nanoseconds\n";
-                auto speed = static_cast<double>(pixels) /
-                             static_cast<double>(duration) * 1e9;
-                std::cout << "speed: " << speed << " pixels per second"
-                          << std::endl;
-                pixels = 0;
-                duration = 0;
+              static mandelbrot::FrameCache cache;
+              auto &regions = cache.update(
+                  canvas, {size, scale, static_cast<double>(center_x),
+                           static_cast<double>(center_y), k_value, tolerance,
+                           mandelbrot::Kernel::Escape, false});
+              if (!regions.empty()) {
+                meter.measure(cache.pending_pixels(), [&] {
+                  return mpiCalculate(canvas, regions, size, scale, center_x,
+                                      center_y, {k_value, tolerance},
+                                      block_rows);
+                });
               }
-              for (int i = 0; i < size; ++i) {
-                for (int j = 0; j < size; ++j) {
-                  if (canvas[{i, j}] == k_value) {
-                    draw_list->AddCircleFilled(ImVec2(x, y), radius, col32);
-                  }
-                  x += spacing;
-                }
-                y += spacing;
-                x = p.x + MARGIN;
+              if (meter.ready()) {
+                meter.report(std::cout);
               }
+              auto colormap = core_colormap(k_value, ImColor(col));
+              painter.draw(canvas, colormap,
+                           ImVec2(p.x + MARGIN, p.y + MARGIN),
+                           spacing * static_cast<float>(size));
             }
             ImGui::End();
           }
         });
+    stopWorkers();
   }
   MPI_Finalize();
   return 0;
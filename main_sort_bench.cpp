@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+#include <odd-even-sort.hpp>
+#include <sort/bench.hpp>
+#include <vector>
+
+// Sorts the file options.input into options.output out of core, repetitions
+// times, and checks on rank 0 that the output is sorted and keeps the length
+// and checksum of the input. Returns the exit code.
+int sort_file(const sort::Context &context,
+              const sort::SortBenchOptions &options, int rank) {
+  sort::FileCheck input;
+  int failed = 0;
+  for (int repetition = 0; repetition < options.repetitions; ++repetition) {
+    // collective, so a missing input fails on every rank alike
+    auto information = context.mpi_sort_file(options.input, options.output);
+    if (0 != rank) {
+      continue;
+    }
+    if (0 == repetition) {
+      input = sort::check_file(options.input);
+    }
+    auto output = sort::check_file(options.output);
+    bool passed = output.sorted && output.length == input.length &&
+                  output.checksum == input.checksum;
+    failed += !passed;
+    sort::Context::print_information(*information, std::cout);
+    std::cout << "external " << options.input << ' ' << input.length << ": "
+              << (passed ? "passed" : "FAILED") << std::endl;
+  }
+  if (failed != 0) {
+    std::cerr << failed << " of " << options.repetitions << " sorts failed"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Runs every selected algorithm of sort::Context on every selected input
+// distribution and size, checks each output for order and for the checksum
+// of its input, and reports the results on rank 0. With --input and
+// --output, sorts that file out of core instead.
+int main(int argc, char **argv) {
+  sort::Context context{argc, argv};
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  sort::SortBenchOptions options;
+  try {
+    if (!sort::parse_sort_bench_options(argc, argv, options)) {
+      if (0 == rank) {
+        std::cout << sort::sort_bench_usage() << std::endl;
+      }
+      return 0;
+    }
+  } catch (const std::exception &error) {
+    if (0 == rank) {
+      std::cerr << error.what() << std::endl;
+    }
+    return 1;
+  }
+  if (!options.input.empty()) {
+    try {
+      return sort_file(context, options, rank);
+    } catch (const std::exception &error) {
+      if (0 == rank) {
+        std::cerr << error.what() << std::endl;
+      }
+      return 1;
+    }
+  }
+
+  std::vector<sort::SortBenchResult> results;
+  for (auto size : options.sizes) {
+    for (auto distribution : options.distributions) {
+      // only rank 0 holds the input of mpi_sort
+      std::vector<sort::Element> input, data;
+      sort::Checksum checksum;
+      if (0 == rank) {
+        input = sort::generate(distribution, size,
+                               options.seed + static_cast<uint64_t>(size));
+        checksum = {input.data(), input.data() + input.size()};
+      }
+      for (auto algorithm : options.algorithms) {
+        if (sort::Algorithm::OddEven == algorithm &&
+            size > options.odd_even_limit) {
+          continue;
+        }
+        context.algorithm = algorithm;
+        for (int repetition = 0; repetition < options.repetitions;
+             ++repetition) {
+          data = input;
+          auto information =
+              context.mpi_sort(data.data(), data.data() + data.size());
+          if (0 != rank) {
+            continue;
+          }
+          sort::SortBenchResult result;
+          result.algorithm = algorithm;
+          result.distribution = distribution;
+          result.size = size;
+          result.num_of_proc = information->num_of_proc;
+          result.repetition = repetition;
+          result.nanoseconds =
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  information->end - information->start)
+                  .count();
+          result.sorted = std::is_sorted(data.begin(), data.end());
+          result.permutation =
+              checksum == sort::Checksum{data.data(), data.data() + size};
+          std::cout << sort::algorithm_list[static_cast<int>(algorithm)]
+                    << ' '
+                    << sort::distribution_list[static_cast<int>(
+                           distribution)]
+                    << ' ' << size << ": " << result.nanoseconds << " ns, "
+                    << result.throughput() << " gb/s"
+                    << (result.passed() ? "" : ", FAILED") << std::endl;
+          results.push_back(result);
+        }
+      }
+    }
+  }
+
+  if (0 != rank) {
+    return 0;
+  }
+  if (!options.csv.empty()) {
+    std::ofstream file{options.csv};
+    sort::write_csv(results, file);
+  }
+  if (!options.json.empty()) {
+    std::ofstream file{options.json};
+    sort::write_json(results, file);
+  }
+  auto failed =
+      std::count_if(results.begin(), results.end(),
+                    [](const auto &result) { return !result.passed(); });
+  if (failed != 0) {
+    std::cerr << failed << " of " << results.size() << " sorts failed"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
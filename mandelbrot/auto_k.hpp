@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mandelbrot {
+
+/// Per-row iteration caps that follow the image from frame to frame.
+///
+/// A row whose pixels escaped close to its cap in the previous frame probably
+/// holds points that would have escaped with a few more iterations, so its
+/// cap is doubled (up to MAX_FACTOR * k_value). A row is halved back towards
+/// k_value only once its slowest escape would stay clear of the halved cap
+/// too, so a cap does not flip between two values on a still image. Raising
+/// the cap everywhere would make every interior pixel pay for it.
+///
+/// Values are stored relative to k_value, so consumers of the canvas see the
+/// usual range: a point that survived the row cap is stored as k_value, a
+/// point that escaped at or after k_value as k_value - 1.
+///
+/// begin_frame and end_frame must not race with observe; observe itself may
+/// be called concurrently for any rows.
+class AutoK {
+public:
+  static constexpr int MAX_FACTOR = 8;
+
+  /// prepare for a frame of `rows` rows; resets all caps when the view size
+  /// or the base K changed
+  void begin_frame(int rows, int k_value) {
+    if (rows != static_cast<int>(caps.size()) || k_value != base) {
+      caps.assign(rows, k_value);
+      slowest = std::make_unique<std::atomic<int>[]>(rows);
+      base = k_value;
+    }
+    for (int i = 0; i < rows; ++i) {
+      slowest[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  int cap(int row) const { return caps[row]; }
+
+  /// look at freshly computed escape times of `row`, remember the slowest
+  /// escape, and map them back to the base K range
+  void observe(int row, int *values, int count) {
+    auto limit = caps[row];
+    int row_slowest = 0;
+    for (int j = 0; j < count; ++j) {
+      auto value = values[j];
+      if (value < limit) {
+        row_slowest = std::max(row_slowest, value);
+      }
+      if (value >= limit) {
+        values[j] = base;
+      } else if (value >= base) {
+        values[j] = base - 1;
+      }
+    }
+    auto current = slowest[row].load(std::memory_order_relaxed);
+    while (current < row_slowest &&
+           !slowest[row].compare_exchange_weak(current, row_slowest,
+                                               std::memory_order_relaxed)) {
+    }
+  }
+
+  /// adjust the caps for the next frame
+  void end_frame() {
+    auto near = [](int value, int cap) { return value >= cap - cap / 8; };
+    for (size_t i = 0; i < caps.size(); ++i) {
+      auto value = slowest[i].load(std::memory_order_relaxed);
+      if (near(value, caps[i])) {
+        caps[i] = static_cast<int>(std::min(
+            std::min(caps[i] * 2L, static_cast<long>(base) * MAX_FACTOR),
+            static_cast<long>(INT32_MAX)));
+      } else if (caps[i] / 2 >= base && !near(value, caps[i] / 2)) {
+        caps[i] /= 2;
+      }
+    }
+  }
+
+private:
+  int base = 0;
+  std::vector<int> caps;
+  std::unique_ptr<std::atomic<int>[]> slowest;
+};
+
+} // namespace mandelbrot
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mandelbrot/kernel.hpp>
+#include <mandelbrot/perturbation.hpp>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace mandelbrot {
+
+/// view and run parameters of a headless benchmark run
+struct BenchOptions {
+  int size = 800;
+  int scale = 1;
+  int center_x = 0;
+  int center_y = 0;
+  int k_value = 100;
+  int threads = 1;
+  int tile = 32;
+  int tile_rows = 1;
+  int tile_cols = 0;
+  int block = 4;
+  int iterations = 10;
+  int warmup = 1;
+  int auto_k = 0;
+  double tolerance = 0.0;
+  std::string isa = "auto";
+  std::string distribution = "block";
+  std::string kernel = "escape";
+  /// decimal center of a deep zoom, rendered by perturbation when given
+  std::string deep_x, deep_y;
+  double zoom = 0.0; ///< log10 of the deep zoom magnification
+
+  /// write the view to this PPM file band by band instead of benchmarking
+  std::string output;
+  int band_rows = 64;
+
+  bool deep_zoom() const { return !deep_x.empty() || !deep_y.empty(); }
+};
+
+/// Accumulates compute time over several frames, so that the reported speed
+/// is not dominated by a single short frame. A frame may return the number of
+/// escape iterations it saved, which is reported per frame as well.
+struct SpeedMeter {
+  size_t threshold;
+  size_t duration = 0;
+  size_t pixels = 0;
+  size_t frames = 0;
+  uint64_t saved = 0;
+
+  explicit SpeedMeter(size_t threshold) : threshold(threshold) {}
+
+  /// run one frame and account for its pixels; returns the frame time in ns
+  template <typename Frame> size_t measure(size_t frame_pixels, Frame &&frame) {
+    using namespace std::chrono;
+    auto begin = high_resolution_clock::now();
+    if constexpr (std::is_void_v<decltype(frame())>) {
+      frame();
+    } else {
+      saved += frame();
+    }
+    auto end = high_resolution_clock::now();
+    auto elapsed =
+        static_cast<size_t>(duration_cast<nanoseconds>(end - begin).count());
+    pixels += frame_pixels;
+    duration += elapsed;
+    frames += 1;
+    return elapsed;
+  }
+
+  bool ready() const { return duration > threshold; }
+
+  double speed() const {
+    return static_cast<double>(pixels) / static_cast<double>(duration) * 1e9;
+  }
+
+  /// print the accumulated speed and start a new accumulation window
+  void report(std::ostream &output) {
+    output << pixels << " pixels in last " << duration << " nanoseconds\n";
+    output << "speed: " << speed() << " pixels per second\n";
+    output << "iterations saved: " << (frames == 0 ? 0 : saved / frames)
+           << " per frame" << std::endl;
+    pixels = 0;
+    duration = 0;
+    frames = 0;
+    saved = 0;
+  }
+};
+
+inline const char *bench_usage() {
+  return "usage: --headless [--size N] [--scale N] [--center-x N] "
+         "[--center-y N] [--k N] [--threads N] [--tile N] "
+         "[--tile-rows N] [--tile-cols N] [--block N] "
+         "[--distribution block|cyclic|block-cyclic] [--iterations N] "
+         "[--warmup N] [--isa auto|scalar|avx2|avx512] "
+         "[--kernel escape|mariani-silver] [--tolerance X] [--auto-k 0|1] "
+         "[--deep-x DECIMAL] [--deep-y DECIMAL] [--zoom LOG10] "
+         "[--output FILE.ppm] [--band-rows N]";
+}
+
+/// Parse the command line. Returns false if `--headless` is not given, so the
+/// caller falls back to the GUI. Fields not mentioned keep their values.
+inline bool parse_bench_options(int argc, char **argv, BenchOptions &options) {
+  struct Flag {
+    const char *name;
+    int *value;
+    int min;
+    int max = INT32_MAX;
+  };
+  const Flag flags[] = {
+      {"--size", &options.size, 1},
+      {"--scale", &options.scale, 1},
+      {"--center-x", &options.center_x, INT32_MIN},
+      {"--center-y", &options.center_y, INT32_MIN},
+      // escape times are stored in the uint16_t canvas
+      {"--k", &options.k_value, 1, UINT16_MAX},
+      {"--threads", &options.threads, 1},
+      {"--tile", &options.tile, 1},
+      {"--tile-rows", &options.tile_rows, 1},
+      {"--tile-cols", &options.tile_cols, 0},
+      {"--block", &options.block, 1},
+      {"--iterations", &options.iterations, 1},
+      {"--warmup", &options.warmup, 0},
+      {"--auto-k", &options.auto_k, 0, 1},
+      {"--band-rows", &options.band_rows, 1},
+  };
+  struct RealFlag {
+    const char *name;
+    double *value;
+  };
+  const RealFlag real_flags[] = {
+      {"--tolerance", &options.tolerance},
+      {"--zoom", &options.zoom},
+  };
+  struct TextFlag {
+    const char *name;
+    std::string *value;
+  };
+  const TextFlag text_flags[] = {
+      {"--isa", &options.isa},
+      {"--distribution", &options.distribution},
+      {"--kernel", &options.kernel},
+      {"--deep-x", &options.deep_x},
+      {"--deep-y", &options.deep_y},
+      {"--output", &options.output},
+  };
+  bool headless = false;
+  for (int i = 1; i < argc; ++i) {
+    if (0 == std::strcmp(argv[i], "--headless")) {
+      headless = true;
+      continue;
+    }
+    bool matched = false;
+    for (const auto &flag : flags) {
+      if (0 != std::strcmp(argv[i], flag.name)) {
+        continue;
+      }
+      if (i + 1 >= argc) {
+        throw std::runtime_error(std::string{"missing value for "} +
+                                 flag.name + "\n" + bench_usage());
+      }
+      char *last = nullptr;
+      auto value = std::strtol(argv[++i], &last, 10);
+      if (*last != '\0' || value < flag.min || value > flag.max) {
+        throw std::runtime_error(std::string{"invalid value for "} +
+                                 flag.name + "\n" + bench_usage());
+      }
+      *flag.value = static_cast<int>(value);
+      matched = true;
+      break;
+    }
+    for (const auto &flag : real_flags) {
+      if (matched || 0 != std::strcmp(argv[i], flag.name)) {
+        continue;
+      }
+      if (i + 1 >= argc) {
+        throw std::runtime_error(std::string{"missing value for "} +
+                                 flag.name + "\n" + bench_usage());
+      }
+      char *last = nullptr;
+      auto value = std::strtod(argv[++i], &last);
+      if (*last != '\0' || !(value >= 0.0)) {
+        throw std::runtime_error(std::string{"invalid value for "} +
+                                 flag.name + "\n" + bench_usage());
+      }
+      *flag.value = value;
+      matched = true;
+    }
+    for (const auto &flag : text_flags) {
+      if (matched || 0 != std::strcmp(argv[i], flag.name)) {
+        continue;
+      }
+      if (i + 1 >= argc) {
+        throw std::runtime_error(std::string{"missing value for "} +
+                                 flag.name + "\n" + bench_usage());
+      }
+      *flag.value = argv[++i];
+      matched = true;
+    }
+    if (!matched) {
+      throw std::runtime_error(std::string{"unknown option "} + argv[i] +
+                               "\n" + bench_usage());
+    }
+  }
+  if (options.zoom > MAX_ZOOM_DIGITS) {
+    throw std::runtime_error(std::string{"invalid value for --zoom\n"} +
+                             bench_usage());
+  }
+  if (options.deep_zoom()) {
+    // an empty coordinate means the real or imaginary axis
+    for (auto *center : {&options.deep_x, &options.deep_y}) {
+      if (center->empty()) {
+        *center = "0";
+      }
+      DeepReal::parse(*center);
+    }
+  }
+  return headless;
+}
+
+/// Render `options.iterations` frames without a display and print one CSV row
+/// per frame plus a total row. `frame` renders a single frame of the view
+/// described by `options` and may return the iterations it saved.
+template <typename Frame>
+int run_bench(const BenchOptions &options, Frame &&frame,
+              std::ostream &output = std::cout) {
+  active_isa() = parse_isa(options.isa);
+  auto frame_pixels = static_cast<size_t>(options.size) *
+                      static_cast<size_t>(options.size);
+  for (int i = 0; i < options.warmup; ++i) {
+    frame();
+  }
+  SpeedMeter total{0};
+  output << "run,size,scale,center_x,center_y,k,threads,isa,pixels,"
+            "nanoseconds,pixels_per_second,iterations_saved\n";
+  auto row = [&](const char *run, size_t pixels, size_t nanoseconds,
+                 uint64_t saved) {
+    output << run << ',' << options.size << ',' << options.scale << ','
+           << options.center_x << ',' << options.center_y << ','
+           << options.k_value << ',' << options.threads << ','
+           << isa_name(active_isa()) << ',' << pixels << ','
+           << nanoseconds << ','
+           << static_cast<double>(pixels) / static_cast<double>(nanoseconds) *
+                  1e9
+           << ',' << saved << '\n';
+  };
+  for (int i = 0; i < options.iterations; ++i) {
+    auto saved_before = total.saved;
+    auto elapsed = total.measure(frame_pixels, frame);
+    row(std::to_string(i).c_str(), frame_pixels, elapsed,
+        total.saved - saved_before);
+  }
+  row("total", total.pixels, total.duration, total.saved);
+  output.flush();
+  return 0;
+}
+
+} // namespace mandelbrot
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <parallel/aligned_allocator.hpp>
+
+namespace mandelbrot {
+
+/// Escape-time canvas of length x length pixels.
+///
+/// Pixels are stored row-major, (row, col) at buffer[row * stride + col],
+/// which is the order the kernels produce them in. `stride` rounds a row up to
+/// whole cache lines, so every row starts on a 64-byte boundary and threads
+/// working on different rows never write to the same line. T only has to hold
+/// k_value; the uint16_t default takes half the memory of int.
+///
+/// A canvas may also hold just a band of rows [origin, origin + rows), for
+/// images too large to keep in memory. Rows are still addressed by their
+/// index in the whole image, so the kernels render into a band unchanged.
+template <typename T = uint16_t> struct Square {
+  static constexpr size_t ALIGNMENT = 64;
+  static_assert(ALIGNMENT % sizeof(T) == 0, "T must tile a cache line");
+
+  std::vector<T, parallel::AlignedAllocator<T, ALIGNMENT>> buffer;
+  size_t length = 0; ///< pixels per side
+  size_t stride = 0; ///< elements from the start of one row to the next
+  size_t origin = 0; ///< first row held
+  size_t rows = 0;   ///< rows held
+
+  explicit Square(size_t length) { resize(length); }
+
+  /// reallocate for a new side length; all pixels are cleared
+  void resize(size_t new_length) { reshape(new_length, 0, new_length); }
+
+  /// hold rows [new_origin, new_origin + new_rows) of a new_length wide
+  /// canvas; all pixels are cleared, the allocation is reused if large enough
+  void reshape(size_t new_length, size_t new_origin, size_t new_rows) {
+    constexpr auto per_line = ALIGNMENT / sizeof(T);
+    length = new_length;
+    stride = (new_length + per_line - 1) / per_line * per_line;
+    origin = new_origin;
+    rows = new_rows;
+    buffer.assign(stride * rows, T{});
+  }
+
+  /// pixel at (row, column)
+  T &operator[](std::pair<size_t, size_t> pos) {
+    return buffer[(pos.first - origin) * stride + pos.second];
+  }
+  const T &operator[](std::pair<size_t, size_t> pos) const {
+    return buffer[(pos.first - origin) * stride + pos.second];
+  }
+
+  T *row(size_t i) { return buffer.data() + (i - origin) * stride; }
+  const T *row(size_t i) const {
+    return buffer.data() + (i - origin) * stride;
+  }
+};
+
+} // namespace mandelbrot
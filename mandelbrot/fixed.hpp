@@ -0,0 +1,174 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace mandelbrot {
+
+/// Signed fixed-point number of Limbs 64-bit limbs in two's complement, least
+/// significant limb first. The top limb is the integer part and the others
+/// hold (Limbs - 1) * 64 fraction bits, so Fixed<8> resolves 2^-448 (about
+/// 1e-134) over [-2^63, 2^63).
+///
+/// Only what a reference orbit needs is provided: +, -, *, parsing decimal
+/// strings and conversion from and to double. Products are truncated and do
+/// not check for overflow.
+template <int Limbs> class Fixed {
+  static_assert(Limbs >= 2, "one integer and at least one fraction limb");
+
+public:
+  Fixed() = default;
+
+  /// exact conversion; |value| must be below 2^63
+  explicit Fixed(double value) {
+    if (!(std::fabs(value) < 0x1p63)) {
+      throw std::runtime_error("value out of range for Fixed");
+    }
+    int exponent;
+    auto fraction = std::frexp(std::fabs(value), &exponent);
+    auto mantissa = static_cast<uint64_t>(std::ldexp(fraction, 53));
+    // weight of the lowest mantissa bit, counted in bits from limb 0 bit 0
+    auto position = exponent - 53 + FRACTION_BITS;
+    if (position < 0) {
+      mantissa = -position < 64 ? mantissa >> -position : 0;
+      position = 0;
+    }
+    auto limb = position / 64, shift = position % 64;
+    limbs[limb] = mantissa << shift;
+    if (shift != 0 && limb + 1 < Limbs) {
+      limbs[limb + 1] = mantissa >> (64 - shift);
+    }
+    if (value < 0) {
+      negate();
+    }
+  }
+
+  /// parse [-+]digits[.digits]; digits past the resolution are truncated
+  static Fixed parse(const std::string &text) {
+    size_t i = 0;
+    bool minus = false;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+      minus = text[i++] == '-';
+    }
+    auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    uint64_t integer = 0;
+    size_t digits = 0;
+    for (; i < text.size() && is_digit(text[i]); ++i, ++digits) {
+      if (integer > (INT64_MAX - 9) / 10) {
+        throw std::runtime_error("integer part too large: " + text);
+      }
+      integer = integer * 10 + static_cast<uint64_t>(text[i] - '0');
+    }
+    Fixed result;
+    if (i < text.size() && text[i] == '.') {
+      auto first = ++i;
+      for (; i < text.size() && is_digit(text[i]); ++i, ++digits) {
+      }
+      // 0.d1 d2 ... dn = (d1 + (d2 + ... (dn + 0) / 10 ...) / 10) / 10
+      for (auto k = i; k > first; --k) {
+        result.limbs[Limbs - 1] = static_cast<uint64_t>(text[k - 1] - '0');
+        result.divide(10);
+      }
+    }
+    if (digits == 0 || i != text.size()) {
+      throw std::runtime_error("not a decimal number: " + text);
+    }
+    result.limbs[Limbs - 1] = integer;
+    if (minus) {
+      result.negate();
+    }
+    return result;
+  }
+
+  bool negative() const {
+    return static_cast<int64_t>(limbs[Limbs - 1]) < 0;
+  }
+
+  double to_double() const {
+    auto magnitude = negative() ? -*this : *this;
+    double value = 0;
+    for (int k = 0; k < Limbs; ++k) {
+      value += std::ldexp(static_cast<double>(magnitude.limbs[k]),
+                          64 * k - FRACTION_BITS);
+    }
+    return negative() ? -value : value;
+  }
+
+  Fixed operator-() const {
+    auto result = *this;
+    result.negate();
+    return result;
+  }
+
+  Fixed operator+(const Fixed &other) const {
+    Fixed result;
+    uint64_t carry = 0;
+    for (int k = 0; k < Limbs; ++k) {
+      auto sum = static_cast<unsigned __int128>(limbs[k]) + other.limbs[k] +
+                 carry;
+      result.limbs[k] = static_cast<uint64_t>(sum);
+      carry = static_cast<uint64_t>(sum >> 64);
+    }
+    return result;
+  }
+
+  Fixed operator-(const Fixed &other) const { return *this + -other; }
+
+  // Schoolbook product of the magnitudes, keeping the limbs from
+  // (Limbs - 1) up to (2 * Limbs - 2) of the 2 * Limbs limb result.
+  Fixed operator*(const Fixed &other) const {
+    auto a = negative() ? -*this : *this;
+    auto b = other.negative() ? -other : other;
+    std::array<uint64_t, 2 * Limbs> product{};
+    for (int i = 0; i < Limbs; ++i) {
+      uint64_t carry = 0;
+      for (int j = 0; j < Limbs; ++j) {
+        auto term = static_cast<unsigned __int128>(a.limbs[i]) * b.limbs[j] +
+                    product[i + j] + carry;
+        product[i + j] = static_cast<uint64_t>(term);
+        carry = static_cast<uint64_t>(term >> 64);
+      }
+      product[i + Limbs] = carry;
+    }
+    Fixed result;
+    for (int k = 0; k < Limbs; ++k) {
+      result.limbs[k] = product[k + Limbs - 1];
+    }
+    if (negative() != other.negative()) {
+      result.negate();
+    }
+    return result;
+  }
+
+  bool operator==(const Fixed &other) const { return limbs == other.limbs; }
+  bool operator!=(const Fixed &other) const { return limbs != other.limbs; }
+
+private:
+  static constexpr int FRACTION_BITS = 64 * (Limbs - 1);
+
+  void negate() {
+    uint64_t carry = 1;
+    for (auto &limb : limbs) {
+      auto sum = static_cast<unsigned __int128>(~limb) + carry;
+      limb = static_cast<uint64_t>(sum);
+      carry = static_cast<uint64_t>(sum >> 64);
+    }
+  }
+
+  // long division of a non-negative value by a small divisor
+  void divide(uint64_t divisor) {
+    unsigned __int128 remainder = 0;
+    for (int k = Limbs - 1; k >= 0; --k) {
+      auto current = remainder << 64 | limbs[k];
+      limbs[k] = static_cast<uint64_t>(current / divisor);
+      remainder = current % divisor;
+    }
+  }
+
+  std::array<uint64_t, Limbs> limbs{};
+};
+
+} // namespace mandelbrot
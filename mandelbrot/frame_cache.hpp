@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <mandelbrot/kernel.hpp>
+#include <mandelbrot/render.hpp>
+#include <parallel/work_stealing.hpp>
+
+namespace mandelbrot {
+
+/// pixels covered by `regions`
+inline size_t region_pixels(const std::vector<parallel::Tile> &regions) {
+  size_t pixels = 0;
+  for (const auto &region : regions) {
+    pixels += static_cast<size_t>(region.row_end - region.row_begin) *
+              static_cast<size_t>(region.col_end - region.col_begin);
+  }
+  return pixels;
+}
+
+/// everything that decides the content of a frame
+struct FrameKey {
+  int size, scale;
+  double x_center, y_center;
+  int k_value;
+  double tolerance;
+  Kernel kernel;
+  bool auto_k; ///< caps move between frames, so nothing can be reused
+};
+
+/// Remembers which frame a canvas holds and works out what is left to compute
+/// for the next one:
+///  - nothing, if no parameter changed;
+///  - the strips uncovered by a pan by whole pixels, after the old pixels are
+///    shifted into place;
+///  - the whole canvas otherwise.
+/// Pixel j maps to (j - size / 2 - x_center) / zoom_factor, and with integral
+/// centers that subtraction is exact, so a shifted pixel is bit-for-bit the
+/// pixel that would have been computed at its new place.
+class FrameCache {
+public:
+  /// Prepare `canvas` for the frame `key` (resizing it if needed) and return
+  /// the regions that still have to be computed, as (row, column) ranges.
+  template <typename Canvas>
+  const std::vector<parallel::Tile> &update(Canvas &canvas,
+                                            const FrameKey &key) {
+    regions.clear();
+    auto isa = active_isa();
+    auto dx = key.x_center - last.x_center;
+    auto dy = key.y_center - last.y_center;
+    bool same_view = valid && key.size == last.size &&
+                     key.scale == last.scale && key.k_value == last.k_value &&
+                     key.tolerance == last.tolerance &&
+                     key.kernel == last.kernel && !key.auto_k &&
+                     !last.auto_k && isa == last_isa;
+    bool integral = whole(key.x_center) && whole(key.y_center) &&
+                    whole(last.x_center) && whole(last.y_center);
+    if (same_view && dx == 0 && dy == 0) {
+      // nothing moved
+    } else if (same_view && integral && std::abs(dx) < key.size &&
+               std::abs(dy) < key.size) {
+      auto shift_cols = static_cast<int>(dx);
+      auto shift_rows = static_cast<int>(dy);
+      shift(canvas, key.size, shift_rows, shift_cols);
+      expose(key.size, shift_rows, shift_cols);
+    } else {
+      canvas.resize(key.size);
+      regions.push_back({0, key.size, 0, key.size});
+    }
+    last = key;
+    last_isa = isa;
+    valid = true;
+    return regions;
+  }
+
+  /// pixels covered by the regions of the last update
+  size_t pending_pixels() const { return region_pixels(regions); }
+
+  /// forget the cached frame, e.g. after the canvas was written elsewhere
+  void invalidate() { valid = false; }
+
+private:
+  static bool whole(double value) { return std::trunc(value) == value; }
+
+  // Move pixel (i - rows, j - cols) to (i, j). Rows are walked against the
+  // direction of movement, so every source row is read before it is
+  // overwritten; within a row memmove copes with the overlap.
+  template <typename Canvas>
+  static void shift(Canvas &canvas, int size, int rows, int cols) {
+    auto count = static_cast<size_t>(size - std::abs(cols));
+    auto to = static_cast<size_t>(std::max(cols, 0));
+    auto from = static_cast<size_t>(std::max(-cols, 0));
+    for (int n = 0; n < size; ++n) {
+      auto i = rows > 0 ? size - 1 - n : n;
+      if (i - rows < 0 || i - rows >= size) {
+        continue;
+      }
+      std::memmove(canvas.row(i) + to, canvas.row(i - rows) + from,
+                   count * sizeof(*canvas.row(i)));
+    }
+  }
+
+  // a band of whole rows plus the uncovered columns of the remaining rows
+  void expose(int size, int rows, int cols) {
+    auto kept_begin = rows > 0 ? rows : 0;
+    auto kept_end = rows < 0 ? size + rows : size;
+    if (rows > 0) {
+      regions.push_back({0, rows, 0, size});
+    } else if (rows < 0) {
+      regions.push_back({size + rows, size, 0, size});
+    }
+    if (cols > 0) {
+      regions.push_back({kept_begin, kept_end, 0, cols});
+    } else if (cols < 0) {
+      regions.push_back({kept_begin, kept_end, size + cols, size});
+    }
+  }
+
+  FrameKey last{};
+  Isa last_isa = Isa::Scalar;
+  bool valid = false;
+  std::vector<parallel::Tile> regions;
+};
+
+} // namespace mandelbrot
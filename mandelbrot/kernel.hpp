@@ -0,0 +1,343 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MANDELBROT_X86 1
+#endif
+
+namespace mandelbrot {
+
+/// Maps canvas coordinates to the complex plane: pixel (i, j) is the point
+/// ((j - cx) / zoom_factor, (i - cy) / zoom_factor).
+struct View {
+  double cx, cy, zoom_factor;
+
+  View(int size, int scale, double x_center, double y_center)
+      : cx(static_cast<double>(size) / 2 + x_center),
+        cy(static_cast<double>(size) / 2 + y_center),
+        zoom_factor(static_cast<double>(size) / 4 * scale) {}
+
+  double x(int j) const { return (static_cast<double>(j) - cx) / zoom_factor; }
+  double y(int i) const { return (static_cast<double>(i) - cy) / zoom_factor; }
+};
+
+/// number of iterations before z escapes, capped at k_value
+inline int escape_time(double x, double y, int k_value) {
+  std::complex<double> z{0, 0};
+  std::complex<double> c{x, y};
+  int k = 0;
+  do {
+    z = z * z + c;
+    k++;
+  } while (norm(z) < 2.0 && k < k_value);
+  return k;
+}
+
+/// Iteration cap of the escape loop plus the distance below which an orbit
+/// counts as periodic. A periodic orbit never escapes, so the pixel gets
+/// k_value right away; a tolerance of 0 disables the check.
+struct Budget {
+  int k_value;
+  double tolerance = 0.0;
+
+  Budget(int k_value, double tolerance = 0.0)
+      : k_value(k_value), tolerance(tolerance) {}
+};
+
+/// Escape time with Brent-style periodicity detection: z is compared with a
+/// snapshot of the orbit taken at iterations 1, 2, 4, 8, ..., so cycles of
+/// any period are caught within twice their preperiod plus period. The
+/// iterations skipped thanks to a detected cycle are added to `saved`.
+inline int escape_time_periodic(double x, double y, Budget budget,
+                                uint64_t &saved) {
+  double zr = 0, zi = 0, sr = 0, si = 0;
+  double tolerance2 = budget.tolerance * budget.tolerance;
+  int k = 0;
+  int snapshot = 1;
+  double norm;
+  do {
+    double zri = zr * zi;
+    zr = zr * zr - zi * zi + x;
+    zi = zri + zri + y;
+    k++;
+    double dr = zr - sr, di = zi - si;
+    if (dr * dr + di * di < tolerance2) {
+      saved += static_cast<uint64_t>(budget.k_value - k);
+      return budget.k_value;
+    }
+    if (k == snapshot) {
+      sr = zr;
+      si = zi;
+      snapshot <<= 1;
+    }
+    norm = zr * zr + zi * zi;
+  } while (norm < 2.0 && k < budget.k_value);
+  return k;
+}
+
+/// True for points in the main cardioid or the period-2 bulb. Those never
+/// escape, so their escape time is k_value without iterating.
+inline bool in_cardioid_or_bulb(double x, double y) {
+  double xq = x - 0.25;
+  double q = xq * xq + y * y;
+  if (q * (q + xq) <= 0.25 * y * y) {
+    return true;
+  }
+  double xb = x + 1.0;
+  return xb * xb + y * y <= 0.0625;
+}
+
+/// instruction set used by escape_row
+enum class Isa { Scalar, Avx2, Avx512 };
+
+inline const char *isa_name(Isa isa) {
+  switch (isa) {
+  case Isa::Avx2:
+    return "avx2";
+  case Isa::Avx512:
+    return "avx512";
+  default:
+    return "scalar";
+  }
+}
+
+inline Isa detect_isa() {
+#ifdef MANDELBROT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return Isa::Avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return Isa::Avx2;
+  }
+#endif
+  return Isa::Scalar;
+}
+
+/// Parse "auto", "scalar", "avx2" or "avx512"; an instruction set the CPU
+/// does not support is rejected.
+inline Isa parse_isa(const std::string &name) {
+  auto best = detect_isa();
+  if (name == "auto") {
+    return best;
+  }
+  for (auto isa : {Isa::Scalar, Isa::Avx2, Isa::Avx512}) {
+    if (name == isa_name(isa)) {
+      if (static_cast<int>(isa) > static_cast<int>(best)) {
+        throw std::runtime_error(name + " is not supported on this CPU");
+      }
+      return isa;
+    }
+  }
+  throw std::runtime_error("unknown instruction set " + name);
+}
+
+/// the instruction set escape_row dispatches to; set it before rendering
+inline Isa &active_isa() {
+  static Isa isa = detect_isa();
+  return isa;
+}
+
+namespace detail {
+
+inline uint64_t escape_row_scalar(int *out, int row, int col_begin,
+                                  int col_end, const View &view,
+                                  Budget budget) {
+  double y = view.y(row);
+  uint64_t saved = 0;
+  for (int j = col_begin; j < col_end; ++j) {
+    *out++ = budget.tolerance > 0
+                 ? escape_time_periodic(view.x(j), y, budget, saved)
+                 : escape_time(view.x(j), y, budget.k_value);
+  }
+  return saved;
+}
+
+#ifdef MANDELBROT_X86
+// Every lane runs z = z * z + c until all lanes have escaped; a lane stops
+// counting as soon as its own norm reaches the bound. The counts match those
+// of escape_time except for rare pixels on an escape boundary, where the
+// fused and reordered arithmetic rounds differently. With Periodic, a lane
+// whose orbit comes back within the tolerance of its last snapshot is
+// finished with k_value.
+template <bool Periodic>
+__attribute__((target("avx2"))) inline uint64_t
+escape_row_avx2(int *out, int row, int col_begin, int col_end,
+                const View &view, Budget budget) {
+  const __m256d ci = _mm256_set1_pd(view.y(row));
+  const __m256d cx = _mm256_set1_pd(view.cx);
+  const __m256d zoom = _mm256_set1_pd(view.zoom_factor);
+  const __m256d bound = _mm256_set1_pd(2.0);
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d cap = _mm256_set1_pd(budget.k_value);
+  const __m256d tolerance2 =
+      _mm256_set1_pd(budget.tolerance * budget.tolerance);
+  __m256d saved = _mm256_setzero_pd();
+  int j = col_begin;
+  for (; j + 4 <= col_end; j += 4, out += 4) {
+    __m256d cr = _mm256_div_pd(
+        _mm256_sub_pd(_mm256_set_pd(j + 3, j + 2, j + 1, j), cx), zoom);
+    __m256d zr = _mm256_setzero_pd();
+    __m256d zi = _mm256_setzero_pd();
+    __m256d sr = zr, si = zi;
+    __m256d count = _mm256_setzero_pd();
+    __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    for (int k = 1, snapshot = 1; k <= budget.k_value; ++k) {
+      __m256d zri = _mm256_mul_pd(zr, zi);
+      zr = _mm256_add_pd(
+          _mm256_sub_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi)), cr);
+      zi = _mm256_add_pd(_mm256_add_pd(zri, zri), ci);
+      count = _mm256_add_pd(count, _mm256_and_pd(active, one));
+      if (Periodic) {
+        __m256d dr = _mm256_sub_pd(zr, sr);
+        __m256d di = _mm256_sub_pd(zi, si);
+        __m256d distance =
+            _mm256_add_pd(_mm256_mul_pd(dr, dr), _mm256_mul_pd(di, di));
+        __m256d periodic = _mm256_and_pd(
+            active, _mm256_cmp_pd(distance, tolerance2, _CMP_LT_OQ));
+        saved = _mm256_add_pd(
+            saved, _mm256_and_pd(periodic, _mm256_sub_pd(cap, count)));
+        count = _mm256_blendv_pd(count, cap, periodic);
+        active = _mm256_andnot_pd(periodic, active);
+        if (k == snapshot) {
+          sr = zr;
+          si = zi;
+          snapshot <<= 1;
+        }
+      }
+      __m256d norm =
+          _mm256_add_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi));
+      active = _mm256_and_pd(active, _mm256_cmp_pd(norm, bound, _CMP_LT_OQ));
+      if (0 == _mm256_movemask_pd(active)) {
+        break;
+      }
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm256_cvtpd_epi32(count));
+  }
+  alignas(32) double lanes[4];
+  _mm256_store_pd(lanes, saved);
+  return static_cast<uint64_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+         escape_row_scalar(out, row, j, col_end, view, budget);
+}
+
+template <bool Periodic>
+__attribute__((target("avx512f"))) inline uint64_t
+escape_row_avx512(int *out, int row, int col_begin, int col_end,
+                  const View &view, Budget budget) {
+  const __m512d ci = _mm512_set1_pd(view.y(row));
+  const __m512d cx = _mm512_set1_pd(view.cx);
+  const __m512d zoom = _mm512_set1_pd(view.zoom_factor);
+  const __m512d bound = _mm512_set1_pd(2.0);
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d cap = _mm512_set1_pd(budget.k_value);
+  const __m512d tolerance2 =
+      _mm512_set1_pd(budget.tolerance * budget.tolerance);
+  __m512d saved = _mm512_setzero_pd();
+  int j = col_begin;
+  for (; j + 8 <= col_end; j += 8, out += 8) {
+    __m512d cr = _mm512_div_pd(
+        _mm512_sub_pd(_mm512_set_pd(j + 7, j + 6, j + 5, j + 4, j + 3, j + 2,
+                                    j + 1, j),
+                      cx),
+        zoom);
+    __m512d zr = _mm512_setzero_pd();
+    __m512d zi = _mm512_setzero_pd();
+    __m512d sr = zr, si = zi;
+    __m512d count = _mm512_setzero_pd();
+    __mmask8 active = 0xFF;
+    for (int k = 1, snapshot = 1; k <= budget.k_value; ++k) {
+      __m512d zri = _mm512_mul_pd(zr, zi);
+      zr = _mm512_add_pd(
+          _mm512_sub_pd(_mm512_mul_pd(zr, zr), _mm512_mul_pd(zi, zi)), cr);
+      zi = _mm512_add_pd(_mm512_add_pd(zri, zri), ci);
+      count = _mm512_mask_add_pd(count, active, count, one);
+      if (Periodic) {
+        __m512d dr = _mm512_sub_pd(zr, sr);
+        __m512d di = _mm512_sub_pd(zi, si);
+        __m512d distance =
+            _mm512_add_pd(_mm512_mul_pd(dr, dr), _mm512_mul_pd(di, di));
+        __mmask8 periodic =
+            _mm512_mask_cmp_pd_mask(active, distance, tolerance2, _CMP_LT_OQ);
+        saved = _mm512_mask_add_pd(saved, periodic, saved,
+                                   _mm512_sub_pd(cap, count));
+        count = _mm512_mask_mov_pd(count, periodic, cap);
+        active = static_cast<__mmask8>(active & ~periodic);
+        if (k == snapshot) {
+          sr = zr;
+          si = zi;
+          snapshot <<= 1;
+        }
+      }
+      __m512d norm =
+          _mm512_add_pd(_mm512_mul_pd(zr, zr), _mm512_mul_pd(zi, zi));
+      active = _mm512_mask_cmp_pd_mask(active, norm, bound, _CMP_LT_OQ);
+      if (0 == active) {
+        break;
+      }
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                        _mm512_cvtpd_epi32(count));
+  }
+  return static_cast<uint64_t>(_mm512_reduce_add_pd(saved)) +
+         escape_row_scalar(out, row, j, col_end, view, budget);
+}
+#endif
+
+} // namespace detail
+
+/// Escape times of the pixels [col_begin, col_end) of canvas row `row`,
+/// written contiguously to `out`. Returns the iterations saved by the
+/// periodicity check.
+inline uint64_t escape_row(int *out, int row, int col_begin, int col_end,
+                           const View &view, Budget budget) {
+  bool periodic = budget.tolerance > 0;
+  switch (active_isa()) {
+#ifdef MANDELBROT_X86
+  case Isa::Avx512:
+    return periodic ? detail::escape_row_avx512<true>(out, row, col_begin,
+                                                      col_end, view, budget)
+                    : detail::escape_row_avx512<false>(out, row, col_begin,
+                                                       col_end, view, budget);
+  case Isa::Avx2:
+    return periodic ? detail::escape_row_avx2<true>(out, row, col_begin,
+                                                    col_end, view, budget)
+                    : detail::escape_row_avx2<false>(out, row, col_begin,
+                                                     col_end, view, budget);
+#endif
+  default:
+    return detail::escape_row_scalar(out, row, col_begin, col_end, view,
+                                     budget);
+  }
+}
+
+/// escape_row, but points inside the cardioid or the period-2 bulb are
+/// filled in directly and only the runs between them are iterated
+inline uint64_t escape_row_checked(int *out, int row, int col_begin,
+                                   int col_end, const View &view,
+                                   Budget budget) {
+  double y = view.y(row);
+  uint64_t saved = 0;
+  int j = col_begin;
+  while (j < col_end) {
+    if (in_cardioid_or_bulb(view.x(j), y)) {
+      out[j - col_begin] = budget.k_value;
+      ++j;
+      continue;
+    }
+    int run_end = j + 1;
+    while (run_end < col_end && !in_cardioid_or_bulb(view.x(run_end), y)) {
+      ++run_end;
+    }
+    saved += escape_row(out + (j - col_begin), row, j, run_end, view, budget);
+    j = run_end;
+  }
+  return saved;
+}
+
+} // namespace mandelbrot
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <mandelbrot/kernel.hpp>
+#include <parallel/work_stealing.hpp>
+
+namespace mandelbrot {
+
+/// Rectangle subdivision (Mariani-Silver) over one tile of a canvas.
+///
+/// The escape time of the border of a rectangle is computed first. If the
+/// whole border has one value, the interior is filled with it. The set and
+/// its escape-time bands are connected, but the border is only sampled at the
+/// pixels, so this is a heuristic: a filament thinner than the pixel spacing
+/// can cross the border between two samples and be missed inside. Otherwise
+/// the rectangle is cut in half along its longer side, only the cutting line
+/// is computed, and both halves are handled the same way. Small rectangles
+/// are computed pixel by pixel.
+template <typename Canvas> class MarianiSilver {
+public:
+  /// rectangles with a side at most this long are not subdivided further
+  static constexpr int MIN_SIDE = 8;
+
+  MarianiSilver(Canvas &canvas, const View &view, Budget budget,
+                std::vector<int> &scratch)
+      : canvas(canvas), view(view), budget(budget), scratch(scratch) {}
+
+  /// fill `tile`; returns the iterations saved by the periodicity check
+  uint64_t render(parallel::Tile tile) {
+    saved = 0;
+    auto rows = tile.row_end - tile.row_begin;
+    auto cols = tile.col_end - tile.col_begin;
+    if (rows <= 2 || cols <= 2) {
+      fill_rows(tile.row_begin, tile.row_end, tile.col_begin, tile.col_end);
+      return saved;
+    }
+    fill_rows(tile.row_begin, tile.row_begin + 1, tile.col_begin, tile.col_end);
+    fill_rows(tile.row_end - 1, tile.row_end, tile.col_begin, tile.col_end);
+    fill_column(tile.col_begin, tile.row_begin + 1, tile.row_end - 1);
+    fill_column(tile.col_end - 1, tile.row_begin + 1, tile.row_end - 1);
+    subdivide(tile.row_begin, tile.row_end, tile.col_begin, tile.col_end);
+    return saved;
+  }
+
+private:
+  auto &at(int i, int j) {
+    return canvas[{static_cast<size_t>(i), static_cast<size_t>(j)}];
+  }
+
+  void fill_rows(int row_begin, int row_end, int col_begin, int col_end) {
+    if (col_begin >= col_end) {
+      return;
+    }
+    scratch.resize(std::max<size_t>(scratch.size(), col_end - col_begin));
+    for (int i = row_begin; i < row_end; ++i) {
+      saved += escape_row_checked(scratch.data(), i, col_begin, col_end, view,
+                                  budget);
+      for (int j = col_begin; j < col_end; ++j) {
+        at(i, j) = scratch[j - col_begin];
+      }
+    }
+  }
+
+  void fill_column(int col, int row_begin, int row_end) {
+    auto x = view.x(col);
+    for (int i = row_begin; i < row_end; ++i) {
+      auto y = view.y(i);
+      if (in_cardioid_or_bulb(x, y)) {
+        at(i, col) = budget.k_value;
+      } else if (budget.tolerance > 0) {
+        at(i, col) = escape_time_periodic(x, y, budget, saved);
+      } else {
+        at(i, col) = escape_time(x, y, budget.k_value);
+      }
+    }
+  }
+
+  bool uniform_border(int row_begin, int row_end, int col_begin, int col_end) {
+    auto value = at(row_begin, col_begin);
+    for (int j = col_begin; j < col_end; ++j) {
+      if (at(row_begin, j) != value || at(row_end - 1, j) != value) {
+        return false;
+      }
+    }
+    for (int i = row_begin + 1; i < row_end - 1; ++i) {
+      if (at(i, col_begin) != value || at(i, col_end - 1) != value) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // the border of [row_begin, row_end) x [col_begin, col_end) is computed
+  void subdivide(int row_begin, int row_end, int col_begin, int col_end) {
+    auto rows = row_end - row_begin;
+    auto cols = col_end - col_begin;
+    if (rows <= 2 || cols <= 2) {
+      return;
+    }
+    if (uniform_border(row_begin, row_end, col_begin, col_end)) {
+      auto value = at(row_begin, col_begin);
+      for (int i = row_begin + 1; i < row_end - 1; ++i) {
+        for (int j = col_begin + 1; j < col_end - 1; ++j) {
+          at(i, j) = value;
+        }
+      }
+      return;
+    }
+    if (rows <= MIN_SIDE || cols <= MIN_SIDE) {
+      fill_rows(row_begin + 1, row_end - 1, col_begin + 1, col_end - 1);
+      return;
+    }
+    if (rows >= cols) {
+      auto middle = row_begin + rows / 2;
+      fill_rows(middle, middle + 1, col_begin + 1, col_end - 1);
+      subdivide(row_begin, middle + 1, col_begin, col_end);
+      subdivide(middle, row_end, col_begin, col_end);
+    } else {
+      auto middle = col_begin + cols / 2;
+      fill_column(middle, row_begin + 1, row_end - 1);
+      subdivide(row_begin, row_end, col_begin, middle + 1);
+      subdivide(row_begin, row_end, middle, col_end);
+    }
+  }
+
+  Canvas &canvas;
+  const View &view;
+  Budget budget;
+  std::vector<int> &scratch;
+  uint64_t saved = 0;
+};
+
+} // namespace mandelbrot
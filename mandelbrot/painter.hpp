@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include <graphic/colormap.hpp>
+#include <graphic/texture.hpp>
+#include <imgui.h>
+#include <mandelbrot/canvas.hpp>
+
+namespace mandelbrot {
+
+/// Shows a canvas as a single image: the escape times are colored row by row
+/// through a Colormap, uploaded to one texture and drawn with one ImGui call.
+/// Holds a GL texture, so it has to be declared after the GraphicContext.
+class Painter {
+public:
+  /// draw `canvas` with its top-left corner at `position`, `extent` pixels
+  /// wide and high
+  void draw(const Square<> &canvas, const graphic::Colormap &colormap,
+            ImVec2 position, float extent) {
+    auto size = canvas.length;
+    pixels.resize(size * size);
+    for (size_t i = 0; i < size; ++i) {
+      colormap.apply(canvas.row(i), size, &pixels[i * size]);
+    }
+    texture.upload(pixels.data(), static_cast<int>(size),
+                   static_cast<int>(size));
+    ImGui::SetCursorScreenPos(position);
+    texture.draw(ImVec2(extent, extent));
+  }
+
+private:
+  graphic::Texture texture;
+  std::vector<ImU32> pixels;
+};
+
+} // namespace mandelbrot
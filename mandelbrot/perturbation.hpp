@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <mandelbrot/fixed.hpp>
+#include <parallel/work_stealing.hpp>
+
+namespace mandelbrot {
+
+/// Reference orbit arithmetic: 448 fraction bits, enough for magnifications up
+/// to about 1e120.
+using DeepReal = Fixed<8>;
+
+/// Deepest magnification (log10) the perturbation engine is meant for; beyond
+/// it the squares of the pixel offsets underflow a double and DeepReal runs
+/// out of digits.
+static constexpr double MAX_ZOOM_DIGITS = 120.0;
+
+/// A view given by a high-precision center and a magnification. Pixel (i, j)
+/// is the center plus ((j - size / 2) * step, (i - size / 2) * step), so
+/// zoom = scale gives the pixel spacing of View.
+struct DeepView {
+  int size;
+  DeepReal x_center, y_center;
+  double step;
+
+  DeepView(int size, const std::string &x_center, const std::string &y_center,
+           double zoom)
+      : size(size), x_center(DeepReal::parse(x_center)),
+        y_center(DeepReal::parse(y_center)),
+        step(4.0 / (static_cast<double>(size) * zoom)) {}
+
+  double dx(int j) const {
+    return (static_cast<double>(j) - static_cast<double>(size) / 2) * step;
+  }
+  double dy(int i) const {
+    return (static_cast<double>(i) - static_cast<double>(size) / 2) * step;
+  }
+};
+
+/// Escape times by perturbation theory.
+///
+/// The orbit Z of the view center is iterated once per frame in DeepReal and
+/// rounded to doubles. A pixel c = center + dc then only follows its offset
+/// d = z - Z, which stays tiny and fits a double:
+///   d' = 2 Z d + d^2 + dc.
+/// When |z| drops below |d|, or Z runs out because the reference escaped, the
+/// pixel is rebased onto the start of the orbit (d = z, Z index 0), which
+/// avoids the classic glitches without picking extra references.
+///
+/// The first iterations are skipped with a cubic series d = A dc + B dc^2 +
+/// C dc^3 whose coefficients follow the reference; the skip is chosen per
+/// frame as long as the cubic term stays negligible over the whole view.
+class Perturbation {
+public:
+  /// relative size of the dropped cubic term up to which the series is used
+  static constexpr double SERIES_EPSILON = 1e-9;
+
+  /// Compute the reference orbit for `view` (only if its center or K changed)
+  /// and the series skip for its pixel spacing. Not thread-safe; call it
+  /// before the workers start.
+  void prepare(const DeepView &view, int k_value, bool series = true) {
+    size = view.size;
+    step = view.step;
+    if (orbit.empty() || k_value != this->k_value ||
+        view.x_center != x_center || view.y_center != y_center) {
+      this->k_value = k_value;
+      x_center = view.x_center;
+      y_center = view.y_center;
+      iterate_reference();
+    }
+    choose_skip(series ? std::hypot(view.dx(0), view.dy(0)) : 0.0);
+  }
+
+  /// iterations of the reference before it escaped (K if it did not)
+  int reference_length() const { return static_cast<int>(orbit.size()) - 1; }
+
+  /// iterations every pixel skips through the series
+  int skipped() const { return skip; }
+
+  /// Escape times of pixels [col_begin, col_end) of row `row`, written
+  /// contiguously to `out`; returns the iterations skipped by the series.
+  uint64_t escape_row(int *out, int row, int col_begin, int col_end) const {
+    auto dci = (static_cast<double>(row) - static_cast<double>(size) / 2) *
+               step;
+    for (int j = col_begin; j < col_end; ++j) {
+      auto dcr = (static_cast<double>(j) - static_cast<double>(size) / 2) *
+                 step;
+      *out++ = escape_time(dcr, dci);
+    }
+    return static_cast<uint64_t>(skip) * (col_end - col_begin);
+  }
+
+  /// escape time of the pixel center + (dcr, dci), with escape_time semantics
+  int escape_time(double dcr, double dci) const {
+    // series start: d = A u + B u^2 + C u^3
+    auto u2r = dcr * dcr - dci * dci, u2i = 2 * dcr * dci;
+    auto u3r = u2r * dcr - u2i * dci, u3i = u2r * dci + u2i * dcr;
+    auto dr = a.re * dcr - a.im * dci + b.re * u2r - b.im * u2i +
+              c.re * u3r - c.im * u3i;
+    auto di = a.re * dci + a.im * dcr + b.re * u2i + b.im * u2r +
+              c.re * u3i + c.im * u3r;
+    auto last = reference_length();
+    int k = skip, m = skip;
+    double norm;
+    do {
+      auto reference = orbit[m];
+      auto next_r = 2 * (reference.re * dr - reference.im * di) + dr * dr -
+                    di * di + dcr;
+      auto next_i =
+          2 * (reference.re * di + reference.im * dr + dr * di) + dci;
+      dr = next_r;
+      di = next_i;
+      ++m;
+      ++k;
+      auto zr = orbit[m].re + dr, zi = orbit[m].im + di;
+      norm = zr * zr + zi * zi;
+      if (m == last || norm < dr * dr + di * di) {
+        dr = zr;
+        di = zi;
+        m = 0;
+      }
+    } while (norm < 2.0 && k < k_value);
+    return k;
+  }
+
+private:
+  struct Complex {
+    double re, im;
+  };
+
+  static Complex mul(Complex x, Complex y) {
+    return {x.re * y.re - x.im * y.im, x.re * y.im + x.im * y.re};
+  }
+  static Complex add(Complex x, Complex y) {
+    return {x.re + y.re, x.im + y.im};
+  }
+  static double abs(Complex x) { return std::hypot(x.re, x.im); }
+
+  // Z_0 = 0, Z_{n+1} = Z_n^2 + C, until |Z|^2 reaches the escape bound of
+  // escape_time or K iterations are done; the escaping Z is kept as well
+  void iterate_reference() {
+    orbit.assign(1, {0.0, 0.0});
+    DeepReal zr, zi;
+    const DeepReal two(2.0);
+    for (int n = 0; n < k_value; ++n) {
+      auto zr2 = zr * zr, zi2 = zi * zi;
+      zi = two * zr * zi + y_center;
+      zr = zr2 - zi2 + x_center;
+      Complex z{zr.to_double(), zi.to_double()};
+      orbit.push_back(z);
+      if (z.re * z.re + z.im * z.im >= 2.0) {
+        break;
+      }
+    }
+  }
+
+  // A' = 2 Z A + 1, B' = 2 Z B + A^2, C' = 2 Z C + 2 A B; stop before the
+  // cubic term over the farthest pixel `radius` stops being negligible next to
+  // the linear one, or before any pixel of the view could have escaped
+  void choose_skip(double radius) {
+    a = b = c = {0.0, 0.0};
+    skip = 0;
+    if (radius <= 0) {
+      return;
+    }
+    auto radius2 = radius * radius;
+    for (int n = 0; n + 1 < reference_length(); ++n) {
+      Complex twice_z{2 * orbit[n].re, 2 * orbit[n].im};
+      auto next_a = add(mul(twice_z, a), {1.0, 0.0});
+      auto next_b = add(mul(twice_z, b), mul(a, a));
+      auto ab = mul(a, b);
+      auto next_c = add(mul(twice_z, c), {2 * ab.re, 2 * ab.im});
+      auto farthest = abs(orbit[n + 1]) + abs(next_a) * radius +
+                      abs(next_b) * radius2 + abs(next_c) * radius2 * radius;
+      if (!(abs(next_c) * radius2 <= SERIES_EPSILON * abs(next_a)) ||
+          !(farthest * farthest < 2.0)) {
+        break;
+      }
+      a = next_a;
+      b = next_b;
+      c = next_c;
+      skip = n + 1;
+    }
+  }
+
+  int size = 0;
+  double step = 0;
+  int k_value = 0;
+  DeepReal x_center, y_center;
+  std::vector<Complex> orbit;
+  Complex a{}, b{}, c{};
+  int skip = 0;
+};
+
+/// Compute the escape times of `tile` into `canvas` by perturbation; returns
+/// the iterations skipped by the series.
+template <typename Canvas>
+uint64_t render_tile(Canvas &canvas, parallel::Tile tile,
+                     const Perturbation &perturbation,
+                     std::vector<int> &scratch) {
+  auto width = static_cast<size_t>(tile.col_end - tile.col_begin);
+  if (scratch.size() < width) {
+    scratch.resize(width);
+  }
+  uint64_t saved = 0;
+  for (int i = tile.row_begin; i < tile.row_end; ++i) {
+    saved += perturbation.escape_row(scratch.data(), i, tile.col_begin,
+                                     tile.col_end);
+    for (int j = tile.col_begin; j < tile.col_end; ++j) {
+      canvas[{static_cast<size_t>(i), static_cast<size_t>(j)}] =
+          scratch[j - tile.col_begin];
+    }
+  }
+  return saved;
+}
+
+} // namespace mandelbrot
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <graphic/colormap.hpp>
+#include <graphic/ppm.hpp>
+#include <imgui.h>
+#include <mandelbrot/canvas.hpp>
+#include <parallel/work_stealing.hpp>
+
+namespace mandelbrot {
+
+/// One band of rows of a poster: its escape times and, once colored, the rgb
+/// bytes of the band in the image file. Reshaping reuses the buffers, so a
+/// whole poster is rendered in O(width x band rows) memory.
+struct PosterBand {
+  Square<> canvas{0};
+  std::vector<ImU32> colors;
+  std::vector<unsigned char> rgb;
+
+  /// hold rows [first_row, first_row + rows) of a size x size poster and
+  /// return them as the region to render
+  parallel::Tile reshape(int size, int first_row, int rows) {
+    canvas.reshape(static_cast<size_t>(size), static_cast<size_t>(first_row),
+                   static_cast<size_t>(rows));
+    return {first_row, first_row + rows, 0, size};
+  }
+
+  /// color the band; returns rgb bytes for graphic::PpmFile::write_rows
+  const unsigned char *color(const graphic::Colormap &colormap) {
+    auto width = canvas.length;
+    colors.resize(width);
+    rgb.resize(canvas.rows * width * graphic::PpmFile::CHANNELS);
+    for (size_t i = 0; i < canvas.rows; ++i) {
+      colormap.apply(canvas.row(canvas.origin + i), width, colors.data());
+      graphic::PpmFile::to_rgb(colors.data(), width,
+                               &rgb[i * width * graphic::PpmFile::CHANNELS]);
+    }
+    return rgb.data();
+  }
+};
+
+/// Render a size x size poster band by band into the PPM file `path`.
+/// `render_band(canvas, region)` computes `region` of the band canvas, where
+/// rows keep their poster indices; it may return the iterations it saved,
+/// which are summed up.
+template <typename RenderBand>
+uint64_t write_poster(const std::string &path, int size, int band_rows,
+                      const graphic::Colormap &colormap,
+                      RenderBand &&render_band) {
+  graphic::PpmFile file(path, static_cast<size_t>(size),
+                        static_cast<size_t>(size));
+  PosterBand band;
+  uint64_t saved = 0;
+  for (int first = 0; first < size; first += band_rows) {
+    auto rows = std::min(band_rows, size - first);
+    auto region = band.reshape(size, first, rows);
+    if constexpr (std::is_void_v<decltype(render_band(band.canvas, region))>) {
+      render_band(band.canvas, region);
+    } else {
+      saved += render_band(band.canvas, region);
+    }
+    file.write_rows(static_cast<size_t>(first), band.color(colormap),
+                    static_cast<size_t>(rows));
+  }
+  return saved;
+}
+
+} // namespace mandelbrot
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <mandelbrot/auto_k.hpp>
+#include <mandelbrot/kernel.hpp>
+#include <mandelbrot/mariani_silver.hpp>
+#include <parallel/work_stealing.hpp>
+
+namespace mandelbrot {
+
+/// algorithm used to fill a tile of the canvas
+enum class Kernel : int { Escape = 0, MarianiSilver = 1 };
+
+inline const char *const kernel_list[2] = {"escape", "mariani-silver"};
+
+inline Kernel parse_kernel(const std::string &name) {
+  for (int i = 0; i < 2; ++i) {
+    if (name == kernel_list[i]) {
+      return static_cast<Kernel>(i);
+    }
+  }
+  throw std::runtime_error("unknown kernel " + name);
+}
+
+/// Compute the escape times of `tile` into `canvas`. `scratch` is a per-thread
+/// row buffer, grown as needed. With `auto_k`, the Escape kernel iterates each
+/// row up to its adaptive cap instead of budget.k_value; Mariani-Silver always
+/// uses the fixed budget, since it fills whole rectangles from their border.
+/// Returns the iterations saved by the periodicity check.
+template <typename Canvas>
+uint64_t render_tile(Canvas &canvas, parallel::Tile tile, const View &view,
+                     Budget budget, Kernel kernel, std::vector<int> &scratch,
+                     AutoK *auto_k = nullptr) {
+  if (kernel == Kernel::MarianiSilver) {
+    return MarianiSilver<Canvas>{canvas, view, budget, scratch}.render(tile);
+  }
+  auto width = static_cast<size_t>(tile.col_end - tile.col_begin);
+  if (scratch.size() < width) {
+    scratch.resize(width);
+  }
+  uint64_t saved = 0;
+  for (int i = tile.row_begin; i < tile.row_end; ++i) {
+    auto row_budget = budget;
+    if (auto_k) {
+      row_budget.k_value = auto_k->cap(i);
+    }
+    saved += escape_row(scratch.data(), i, tile.col_begin, tile.col_end, view,
+                        row_budget);
+    if (auto_k) {
+      auto_k->observe(i, scratch.data(), static_cast<int>(width));
+    }
+    for (int j = tile.col_begin; j < tile.col_end; ++j) {
+      canvas[{static_cast<size_t>(i), static_cast<size_t>(j)}] =
+          scratch[j - tile.col_begin];
+    }
+  }
+  return saved;
+}
+
+} // namespace mandelbrot
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <nbody/body.hpp>
+
+namespace nbody {
+
+/// Barnes-Hut force engine over the x, y and m arrays of a BodyPool.
+///
+/// build() sorts the bodies into a quadtree whose cells keep their total mass
+/// and center of mass; the nodes and the body order live in arrays that are
+/// reused every tick, so a tick allocates nothing once the pool size is
+/// stable. accelerate() walks the tree for one body and treats a cell as a
+/// single mass once it is seen under an angle below theta (cell size over
+/// distance). Cells closer than the collision radius are always opened, so
+/// the colliding pairs still go through the exact BodyPool::check_and_update,
+/// or are left to a CollisionGrid. theta = 0 opens every cell and gives the
+/// exact pairwise gravity over the positions at build(). update() resolves
+/// the collisions only after the traversal, so with collisions it differs
+/// from the pairwise loop, which pulls later pairs with the moved bodies.
+class BarnesHut {
+public:
+  static constexpr uint32_t LEAF_SIZE = 8;
+  static constexpr int MAX_DEPTH = 32;
+
+  double theta;
+
+  explicit BarnesHut(double theta = 0.5) : theta(theta) {}
+
+  /// build the tree over the current positions and masses of `pool`
+  void build(const BodyPool &pool) {
+    auto n = pool.x.size();
+    nodes.clear();
+    order.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      order[i] = static_cast<uint32_t>(i);
+    }
+    if (n == 0) {
+      return;
+    }
+    auto [x_min, x_max] = std::minmax_element(pool.x.begin(), pool.x.end());
+    auto [y_min, y_max] = std::minmax_element(pool.y.begin(), pool.y.end());
+    auto half = std::max({(*x_max - *x_min) / 2, (*y_max - *y_min) / 2, 1.0});
+    nodes.push_back({(*x_min + *x_max) / 2, (*y_min + *y_max) / 2, half});
+    split(pool, 0, 0, static_cast<uint32_t>(n), 0);
+  }
+
+  /// Add the gravity of all other bodies on body i to its acceleration,
+  /// calling near(j) for every other body j within the radius instead of
+  /// pulling it. near() must not move any body before the traversals of all
+  /// bodies are done, or a pair may be pulled on one side only. The tree
+  /// must have been built over the same pool.
+  template <typename Near>
+  void accelerate(BodyPool &pool, size_t i, double radius, double gravity,
+                  Near &&near) const {
+    if (nodes.empty()) {
+      return;
+    }
+    auto x = pool.x[i], y = pool.y[i];
+    double ax = 0, ay = 0;
+    // pulls towards a mass at (to_x, to_y) as check_and_update does, with
+    // the distance clamped to the radius
+    auto pull = [&](double mass, double to_x, double to_y) {
+      auto delta_x = x - to_x, delta_y = y - to_y;
+      auto distance_square =
+          std::max(delta_x * delta_x + delta_y * delta_y, radius * radius);
+      auto scalar = gravity / distance_square / std::sqrt(distance_square);
+      ax -= scalar * delta_x * mass;
+      ay -= scalar * delta_y * mass;
+    };
+    // every pop pushes at most four children, one level deeper
+    std::array<uint32_t, 3 * MAX_DEPTH + 4> stack;
+    size_t top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const auto &node = nodes[stack[--top]];
+      if (node.count == 0) {
+        continue;
+      }
+      auto delta_x = x - node.mass_x, delta_y = y - node.mass_y;
+      auto distance_square = delta_x * delta_x + delta_y * delta_y;
+      auto size = 2 * node.half;
+      // distance from the body to the cell, zero inside
+      auto out_x = std::max(std::abs(x - node.x) - node.half, 0.0);
+      auto out_y = std::max(std::abs(y - node.y) - node.half, 0.0);
+      auto touching = out_x * out_x + out_y * out_y <= radius * radius;
+      if (!touching && size * size < theta * theta * distance_square) {
+        pull(node.mass, node.mass_x, node.mass_y);
+      } else if (node.child != 0) {
+        for (uint32_t c = 0; c < 4; ++c) {
+          stack[top++] = node.child + c;
+        }
+      } else {
+        for (auto k = node.first; k < node.first + node.count; ++k) {
+          auto j = order[k];
+          if (j == i) {
+            continue;
+          }
+          auto body_x = pool.x[j] - x, body_y = pool.y[j] - y;
+          if (body_x * body_x + body_y * body_y <= radius * radius) {
+            near(static_cast<size_t>(j));
+          } else {
+            pull(pool.m[j], pool.x[j], pool.y[j]);
+          }
+        }
+      }
+    }
+    pool.ax[i] += ax;
+    pool.ay[i] += ay;
+  }
+
+  /// Build, then accelerate the bodies [first, last) and resolve their
+  /// collisions with the bodies j > i through the exact check_and_update.
+  /// Without `collide`, the bodies within the radius are left to a collision
+  /// broad phase.
+  void update(BodyPool &pool, size_t first, size_t last, double radius,
+              double gravity, bool collide = true) {
+    build(pool);
+    pairs.clear();
+    for (auto i = first; i < last; ++i) {
+      accelerate(pool, i, radius, gravity, [&](size_t j) {
+        if (collide && j > i) {
+          pairs.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+        }
+      });
+    }
+    // the collision moves wait for the traversals, so both bodies of a pair
+    // decide near or far on the same positions; they are then applied in the
+    // order of the pairwise loop
+    std::sort(pairs.begin(), pairs.end());
+    for (auto [i, j] : pairs) {
+      pool.check_and_update(pool.get_body(i), pool.get_body(j), radius,
+                            gravity);
+    }
+  }
+
+  size_t node_count() const { return nodes.size(); }
+
+private:
+  struct Node {
+    double x, y, half; ///< square cell
+    double mass = 0, mass_x = 0, mass_y = 0;
+    uint32_t first = 0, count = 0; ///< bodies order[first, first + count)
+    uint32_t child = 0;            ///< first of four children, 0 for a leaf
+  };
+
+  // fill in node `index` over order[first, first + count) and split it into
+  // quadrants while it holds more than LEAF_SIZE bodies
+  void split(const BodyPool &pool, uint32_t index, uint32_t first,
+             uint32_t count, int depth) {
+    double mass = 0, mass_x = 0, mass_y = 0;
+    for (auto k = first; k < first + count; ++k) {
+      auto j = order[k];
+      mass += pool.m[j];
+      mass_x += pool.m[j] * pool.x[j];
+      mass_y += pool.m[j] * pool.y[j];
+    }
+    auto &node = nodes[index];
+    node.first = first;
+    node.count = count;
+    node.mass = mass;
+    node.mass_x = mass > 0 ? mass_x / mass : node.x;
+    node.mass_y = mass > 0 ? mass_y / mass : node.y;
+    if (count <= LEAF_SIZE || depth == MAX_DEPTH) {
+      return;
+    }
+    auto x = node.x, y = node.y, half = node.half / 2;
+    // quadrants in the order (low y, low x), (low y, high x), (high y, low
+    // x), (high y, high x)
+    auto *begin = order.data() + first, *end = begin + count;
+    auto *middle = std::partition(
+        begin, end, [&](uint32_t j) { return pool.y[j] < y; });
+    auto *low = std::partition(begin, middle,
+                               [&](uint32_t j) { return pool.x[j] < x; });
+    auto *high = std::partition(middle, end,
+                                [&](uint32_t j) { return pool.x[j] < x; });
+    const uint32_t *bounds[5] = {begin, low, middle, high, end};
+    auto child = static_cast<uint32_t>(nodes.size());
+    nodes[index].child = child;
+    for (int c = 0; c < 4; ++c) {
+      nodes.push_back({x + (c % 2 ? half : -half), y + (c / 2 ? half : -half),
+                       half});
+    }
+    for (uint32_t c = 0; c < 4; ++c) {
+      split(pool, child + c, static_cast<uint32_t>(bounds[c] - order.data()),
+            static_cast<uint32_t>(bounds[c + 1] - bounds[c]), depth + 1);
+    }
+  }
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> order;
+  std::vector<std::pair<uint32_t, uint32_t>> pairs; ///< colliding, i < j
+};
+
+} // namespace nbody
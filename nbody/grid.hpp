@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <nbody/body.hpp>
+
+namespace nbody {
+
+/// Collision broad phase over the x and y arrays of a BodyPool: a uniform
+/// grid of cells at least `radius` wide, so two bodies within the radius are
+/// in the same or in neighbouring cells. build() bins the bodies with a
+/// counting sort into arrays reused every tick, so finding the colliding
+/// pairs costs O(n) for bodies spread over the space.
+///
+/// Only the collision response of check_and_update is applied; pair it with
+/// a long-range engine that leaves the pairs within the radius alone, such
+/// as BarnesHut::update with `collide` off.
+class CollisionGrid {
+public:
+  /// most cells per body, the cells grow beyond the radius to keep to it
+  static constexpr size_t CELLS_PER_BODY = 2;
+
+  /// bin the current positions of `pool` into cells of at least `radius`
+  void build(const BodyPool &pool, double radius) {
+    auto n = pool.x.size();
+    cell_of.resize(n);
+    order.resize(n);
+    if (n == 0) {
+      start.assign(1, 0);
+      columns = rows = 0;
+      return;
+    }
+    auto [x_min, x_max] = std::minmax_element(pool.x.begin(), pool.x.end());
+    auto [y_min, y_max] = std::minmax_element(pool.y.begin(), pool.y.end());
+    left = *x_min;
+    top = *y_min;
+    auto width = *x_max - left, height = *y_max - top;
+    auto limit = static_cast<double>(CELLS_PER_BODY * n);
+    cell = std::max({radius, std::sqrt(width * height / limit), 1e-9});
+    // grow the cells until the grid fits the limit
+    while ((std::floor(width / cell) + 1) * (std::floor(height / cell) + 1) >
+           limit) {
+      cell *= 1.5;
+    }
+    columns = static_cast<size_t>(width / cell) + 1;
+    rows = static_cast<size_t>(height / cell) + 1;
+
+    // counting sort of the bodies by cell
+    start.assign(columns * rows + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+      cell_of[i] = static_cast<uint32_t>(row(pool.y[i]) * columns +
+                                         column(pool.x[i]));
+      ++start[cell_of[i] + 1];
+    }
+    for (size_t c = 1; c < start.size(); ++c) {
+      start[c] += start[c - 1];
+    }
+    fill.assign(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+      order[fill[cell_of[i]]++] = static_cast<uint32_t>(i);
+    }
+  }
+
+  /// Call near(j) for every other body j within `radius` of body i, among
+  /// the neighbours found by the last build(). The distance is taken at the
+  /// call, after the earlier calls moved any bodies.
+  template <typename Near>
+  void for_each_neighbour(const BodyPool &pool, size_t i, double radius,
+                          Near &&near) const {
+    auto c = cell_of[i];
+    auto column = c % columns, row = c / columns;
+    for (auto r = row == 0 ? 0 : row - 1; r <= std::min(row + 1, rows - 1);
+         ++r) {
+      for (auto q = column == 0 ? 0 : column - 1;
+           q <= std::min(column + 1, columns - 1); ++q) {
+        auto neighbour = r * columns + q;
+        for (auto k = start[neighbour]; k < start[neighbour + 1]; ++k) {
+          auto j = order[k];
+          if (j == i) {
+            continue;
+          }
+          auto delta_x = pool.x[i] - pool.x[j];
+          auto delta_y = pool.y[i] - pool.y[j];
+          if (delta_x * delta_x + delta_y * delta_y <= radius * radius) {
+            near(static_cast<size_t>(j));
+          }
+        }
+      }
+    }
+  }
+
+  /// call pair(i, j) once for every pair of bodies within `radius` with i in
+  /// [first, last) and j > i
+  template <typename Pair>
+  void for_each_pair(const BodyPool &pool, size_t first, size_t last,
+                     double radius, Pair &&pair) const {
+    for (auto i = first; i < last; ++i) {
+      for_each_neighbour(pool, i, radius, [&](size_t j) {
+        if (j > i) {
+          pair(i, j);
+        }
+      });
+    }
+  }
+
+  /// collision response of check_and_update for the colliding pairs of the
+  /// bodies [first, last)
+  void collide(BodyPool &pool, size_t first, size_t last, double radius,
+               double gravity) const {
+    for_each_pair(pool, first, last, radius, [&](size_t i, size_t j) {
+      pool.check_and_update(pool.get_body(i), pool.get_body(j), radius,
+                            gravity);
+    });
+  }
+
+  /// build, then collide the bodies [first, last)
+  void update(BodyPool &pool, size_t first, size_t last, double radius,
+              double gravity) {
+    build(pool, radius);
+    collide(pool, first, last, radius, gravity);
+  }
+
+private:
+  size_t column(double x) const {
+    return std::min(static_cast<size_t>((x - left) / cell), columns - 1);
+  }
+  size_t row(double y) const {
+    return std::min(static_cast<size_t>((y - top) / cell), rows - 1);
+  }
+
+  double left = 0, top = 0, cell = 1;
+  size_t columns = 0, rows = 0;
+  std::vector<uint32_t> cell_of; ///< cell of every body
+  std::vector<uint32_t> start;   ///< cell c holds order[start[c], start[c + 1])
+  std::vector<uint32_t> fill;    ///< scratch of the counting sort
+  std::vector<uint32_t> order;
+};
+
+} // namespace nbody
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <nbody/body.hpp>
+
+namespace nbody {
+
+/// Owner-computes tick of the bodies [first, last) of a BodyPool whose other
+/// bodies belong to other ranks, in a replicated-data decomposition.
+///
+/// check_and_update changes both bodies of a pair, which loses the update of
+/// a body owned elsewhere. Here each owner applies only the half of a pair
+/// that belongs to its body: the gravity on it, and its share of a collision,
+/// both computed from the state of the pair at the start of the tick. The
+/// halves of the two owners add up to check_and_update. Collision moves are
+/// kept apart and applied by finish(), so every owner sees the same state.
+class SliceUpdate {
+public:
+  /// start a tick of the bodies [first, last) and clear their accelerations
+  void start(BodyPool &pool, size_t first, size_t last) {
+    this->first = first;
+    this->last = last;
+    std::fill(pool.ax.begin() + first, pool.ax.begin() + last, 0.0);
+    std::fill(pool.ay.begin() + first, pool.ay.begin() + last, 0.0);
+    moves.assign(4 * (last - first), 0.0);
+  }
+
+  /// gravity of body j on the owned body i, with the distance clamped to
+  /// the radius as check_and_update does
+  void pull(BodyPool &pool, size_t i, size_t j, double radius,
+            double gravity) const {
+    auto delta_x = pool.x[i] - pool.x[j], delta_y = pool.y[i] - pool.y[j];
+    auto distance_square =
+        std::max(delta_x * delta_x + delta_y * delta_y, radius * radius);
+    auto scalar = gravity / distance_square / std::sqrt(distance_square);
+    pool.ax[i] -= scalar * delta_x * pool.m[j];
+    pool.ay[i] -= scalar * delta_y * pool.m[j];
+  }
+
+  /// the share of the owned body i of its collision with body j
+  void collide(const BodyPool &pool, size_t i, size_t j, double radius) {
+    auto delta_x = pool.x[i] - pool.x[j], delta_y = pool.y[i] - pool.y[j];
+    auto distance_square =
+        std::max(delta_x * delta_x + delta_y * delta_y, radius * radius);
+    auto distance = std::sqrt(distance_square);
+    auto dot_prod = delta_x * (pool.vx[i] - pool.vx[j]) +
+                    delta_y * (pool.vy[i] - pool.vy[j]);
+    auto scalar = 2 / (pool.m[i] + pool.m[j]) * dot_prod / distance_square;
+    auto relax = (1 + BodyPool::COLLISION_RATIO) * radius / 2.0 / distance;
+    auto *move = &moves[4 * (i - first)];
+    move[0] -= scalar * delta_x * pool.m[j];
+    move[1] -= scalar * delta_y * pool.m[j];
+    move[2] += delta_x * relax;
+    move[3] += delta_y * relax;
+  }
+
+  /// Exact pairwise interactions of the owned bodies with all bodies: pull
+  /// by the bodies beyond the radius, collide with the others unless
+  /// `collide` is off and a broad phase takes care of them.
+  void pairwise(BodyPool &pool, double radius, double gravity,
+                bool collide = true) {
+    for (auto i = first; i < last; ++i) {
+      for (size_t j = 0; j < pool.x.size(); ++j) {
+        if (j == i) {
+          continue;
+        }
+        auto delta_x = pool.x[i] - pool.x[j], delta_y = pool.y[i] - pool.y[j];
+        if (delta_x * delta_x + delta_y * delta_y > radius * radius) {
+          pull(pool, i, j, radius, gravity);
+        } else if (collide) {
+          this->collide(pool, i, j, radius);
+        }
+      }
+    }
+  }
+
+  /// apply the collision moves, then advance the owned bodies by `elapse`
+  void finish(BodyPool &pool, double elapse, double space, double radius) {
+    for (auto i = first; i < last; ++i) {
+      const auto *move = &moves[4 * (i - first)];
+      pool.vx[i] += move[0];
+      pool.vy[i] += move[1];
+      pool.x[i] += move[2];
+      pool.y[i] += move[3];
+      pool.get_body(i).update_for_tick(elapse, space, radius);
+    }
+  }
+
+private:
+  size_t first = 0, last = 0;
+  std::vector<double> moves; ///< vx, vy, x and y change of every owned body
+};
+
+} // namespace nbody
@@ -1,16 +1,600 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <mpi.h>
 #include <odd-even-sort.hpp>
+#include <parallel/thread_pool.hpp>
+#include <sort/external.hpp>
+#include <sort/parallel_sort.hpp>
+#include <sort/profile.hpp>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 namespace sort {
 using namespace std::chrono;
 
+namespace {
+// Split `length` elements into `parts` blocks whose sizes differ by at most
+// one, the longer blocks first.
+void balance(int length, int parts, std::vector<int> &counts,
+             std::vector<int> &displs) {
+  counts.resize(parts);
+  displs.resize(parts);
+  for (int i = 0; i < parts; ++i) {
+    counts[i] = length / parts + (i < length % parts ? 1 : 0);
+    displs[i] = i == 0 ? 0 : displs[i - 1] + counts[i - 1];
+  }
+}
+
+// MPI datatype of Element, created by the Context: the integer type of the
+// same size for integral elements, its raw bytes otherwise
+MPI_Datatype element_type = MPI_DATATYPE_NULL;
+
+MPI_Datatype make_element_type() {
+  MPI_Datatype base = MPI_BYTE;
+  int count = sizeof(Element);
+  if constexpr (std::is_integral_v<Element>) {
+    MPI_Type_match_size(MPI_TYPECLASS_INTEGER, sizeof(Element), &base);
+    count = 1;
+  }
+  MPI_Datatype type;
+  MPI_Type_contiguous(count, base, &type);
+  MPI_Type_commit(&type);
+  return type;
+}
+
+// phases of this rank in the current mpi_sort, see Context::profile
+Profiler profiler;
+
+size_t bytes_of(size_t elements) { return elements * sizeof(Element); }
+
+template <typename Step> void compute(const char *name, Step &&step) {
+  profiler.record(Phase::Compute, name, 0, step);
+}
+
+template <typename Step>
+void p2p(const char *name, size_t bytes, Step &&step) {
+  profiler.record(Phase::PointToPoint, name, bytes, step);
+}
+
+// A collective over `comm` moving `bytes` in and out of this rank. While
+// profiling, a barrier first takes the wait for the slowest rank as idle
+// time, so the collective itself is timed from a common start.
+template <typename Step>
+void collective(const char *name, size_t bytes, MPI_Comm comm, Step &&step) {
+  if (profiler.enabled()) {
+    profiler.record(Phase::Idle, name, 0, [&] { MPI_Barrier(comm); });
+  }
+  profiler.record(Phase::Collective, name, bytes, step);
+}
+
+// Odd-even transposition over the whole array: round `phase` compares the
+// pairs (g, g + 1) of global indices g with the parity of the phase, so
+// global_length rounds sort it. The block of this rank starts at global index
+// `first`; a pair across a block boundary is settled by exchanging the two
+// boundary elements, the left rank keeping the smaller one.
+//
+// A boundary element is never part of a local pair in the round of its
+// exchange, so the exchange is posted first and completes while the interior
+// pairs are compared. Every `check_rounds` rounds the ranks agree whether any
+// element moved since the last check; if none did in those rounds (both
+// parities), the array is sorted and the remaining rounds are skipped.
+void odd_even_transposition(Element *local_array, int local_length, int first,
+                            int global_length, int rank, int num_of_proc,
+                            int check_rounds) {
+  Element left_buff, right_buff;
+  auto last = first + local_length - 1;
+  int swapped = 0;
+
+  for (int phase = 0; phase < global_length; ++phase) {
+    bool left = rank != 0 && (first - 1) % 2 == phase % 2;
+    bool right = rank != num_of_proc - 1 && last % 2 == phase % 2;
+    MPI_Request requests[4];
+    int pending = 0;
+    p2p("boundary exchange", bytes_of(2 * (left + right)), [&] {
+      if (left) {
+        MPI_Irecv(&left_buff, 1, element_type, rank - 1, 0, MPI_COMM_WORLD,
+                  &requests[pending++]);
+        MPI_Isend(&local_array[0], 1, element_type, rank - 1, 0,
+                  MPI_COMM_WORLD, &requests[pending++]);
+      }
+      if (right) {
+        MPI_Irecv(&right_buff, 1, element_type, rank + 1, 0, MPI_COMM_WORLD,
+                  &requests[pending++]);
+        MPI_Isend(&local_array[local_length - 1], 1, element_type, rank + 1,
+                  0, MPI_COMM_WORLD, &requests[pending++]);
+      }
+    });
+
+    // Inner Bubbling: local index of the first pair of this phase
+    compute("compare-swap", [&] {
+      for (int loc_idx = (first + phase) % 2; loc_idx + 1 < local_length;
+           loc_idx += 2) {
+        if (local_array[loc_idx] > local_array[loc_idx + 1]) {
+          std::swap(local_array[loc_idx], local_array[loc_idx + 1]);
+          swapped = 1;
+        }
+      }
+    });
+
+    p2p("boundary wait", 0, [&] {
+      MPI_Waitall(pending, requests, MPI_STATUSES_IGNORE);
+    });
+    // Left Boundary: keep the larger element
+    if (left && left_buff > local_array[0]) {
+      local_array[0] = left_buff;
+      swapped = 1;
+    }
+    // Right Boundary: keep the smaller element
+    if (right && right_buff < local_array[local_length - 1]) {
+      local_array[local_length - 1] = right_buff;
+      swapped = 1;
+    }
+
+    if ((phase + 1) % check_rounds == 0) {
+      collective("sorted check", 2 * sizeof(int), MPI_COMM_WORLD, [&] {
+        MPI_Allreduce(MPI_IN_PLACE, &swapped, 1, MPI_INT, MPI_LOR,
+                      MPI_COMM_WORLD);
+      });
+      if (!swapped) {
+        break;
+      }
+      swapped = 0;
+    }
+  }
+}
+
+// Keep in `mine` the mine.size() smallest (`low`) or largest elements of the
+// sorted blocks `mine` and `theirs`, in order; `merged` is scratch.
+void merge_split(std::vector<Element> &mine,
+                 const std::vector<Element> &theirs, bool low,
+                 std::vector<Element> &merged) {
+  merged.resize(mine.size());
+  if (low) {
+    auto a = mine.cbegin(), b = theirs.cbegin();
+    for (auto &out : merged) {
+      out = (b == theirs.cend() || (a != mine.cend() && *a <= *b)) ? *a++
+                                                                     : *b++;
+    }
+  } else {
+    auto a = mine.crbegin(), b = theirs.crbegin();
+    for (auto out = merged.rbegin(); out != merged.rend(); ++out) {
+      *out = (b == theirs.crend() || (a != mine.crend() && *a >= *b)) ? *a++
+                                                                        : *b++;
+    }
+  }
+  mine.swap(merged);
+}
+
+// Block odd-even sort of sorted blocks: num_of_proc phases of
+// merge-split between neighbours, alternating between (even, odd) and
+// (odd, even) pairs. The lower rank of a pair keeps the smaller half.
+//
+// num_of_proc phases only suffice for blocks of one size, so shorter blocks
+// are padded with the largest Element. Padding sorts to the end of the array,
+// where that many largest values are dropped again.
+void block_odd_even(std::vector<Element> &local, int rank, int num_of_proc,
+                    int global_length) {
+  auto block = (global_length + num_of_proc - 1) / num_of_proc;
+  local.resize(block, std::numeric_limits<Element>::max());
+  std::vector<Element> theirs(block), merged;
+  for (int phase = 0; phase < num_of_proc; ++phase) {
+    auto partner = (phase % 2 == rank % 2) ? rank + 1 : rank - 1;
+    if (partner < 0 || partner >= num_of_proc) {
+      continue;
+    }
+    p2p("block exchange", bytes_of(2 * static_cast<size_t>(block)), [&] {
+      MPI_Sendrecv(local.data(), block, element_type, partner, 0,
+                   theirs.data(), block, element_type, partner, 0,
+                   MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    });
+    // the pair is already in order, nothing to move
+    if (partner > rank ? local.back() <= theirs.front()
+                       : theirs.back() <= local.front()) {
+      continue;
+    }
+    compute("merge-split",
+            [&] { merge_split(local, theirs, partner > rank, merged); });
+  }
+  local.resize(std::clamp(global_length - rank * block, 0, block));
+}
+
+// Splitters of sample sort among the ranks of `comm`: all ranks' sorted
+// `samples` are gathered, and size - 1 of them evenly spaced become the
+// splitters. Without any sample every element goes to the last rank.
+std::vector<Element> choose_splitters(const std::vector<Element> &samples,
+                                      MPI_Comm comm) {
+  int size;
+  MPI_Comm_size(comm, &size);
+  auto buckets = static_cast<size_t>(size);
+  std::vector<int> sample_counts(buckets), sample_displs(buckets);
+  auto sample_count = static_cast<int>(samples.size());
+  collective("sample counts", 2 * buckets * sizeof(int), comm, [&] {
+    MPI_Allgather(&sample_count, 1, MPI_INT, sample_counts.data(), 1, MPI_INT,
+                  comm);
+  });
+  for (size_t i = 1; i < buckets; ++i) {
+    sample_displs[i] = sample_displs[i - 1] + sample_counts[i - 1];
+  }
+  std::vector<Element> all_samples(
+      static_cast<size_t>(sample_displs.back() + sample_counts.back()));
+  collective("samples", bytes_of(samples.size() + all_samples.size()), comm,
+             [&] {
+               MPI_Allgatherv(samples.data(), sample_count, element_type,
+                              all_samples.data(), sample_counts.data(),
+                              sample_displs.data(), element_type, comm);
+             });
+  compute("splitters",
+          [&] { std::sort(all_samples.begin(), all_samples.end()); });
+
+  std::vector<Element> splitters(buckets - 1,
+                                 std::numeric_limits<Element>::max());
+  if (!all_samples.empty()) {
+    for (size_t i = 0; i + 1 < buckets; ++i) {
+      splitters[i] = all_samples[(i + 1) * all_samples.size() / buckets];
+    }
+  }
+  return splitters;
+}
+
+// `count` regular samples of a sorted block of `length` elements
+std::vector<Element> regular_samples(const Element *sorted, size_t length,
+                                     size_t count) {
+  std::vector<Element> samples(count);
+  for (size_t i = 0; i < count; ++i) {
+    samples[i] = sorted[(i + 1) * length / (count + 1)];
+  }
+  return samples;
+}
+
+// Bucket exchange of sample sort among the ranks of `comm`: the splitters cut
+// the sorted block into one bucket per rank, which are exchanged all-to-all.
+// Returns the received buckets, one sorted run per sender, with the bounds of
+// the runs in `runs`.
+std::vector<Element> exchange_buckets(const Element *sorted, size_t length,
+                                      const std::vector<Element> &splitters,
+                                      MPI_Comm comm,
+                                      std::vector<size_t> &runs) {
+  auto buckets = splitters.size() + 1;
+  std::vector<int> send_counts(buckets), send_displs(buckets);
+  compute("bucket split", [&] {
+    size_t first = 0;
+    for (size_t i = 0; i < buckets; ++i) {
+      auto last = i + 1 == buckets
+                      ? length
+                      : static_cast<size_t>(
+                            std::upper_bound(sorted + first, sorted + length,
+                                             splitters[i]) -
+                            sorted);
+      send_displs[i] = static_cast<int>(first);
+      send_counts[i] = static_cast<int>(last - first);
+      first = last;
+    }
+  });
+  std::vector<int> recv_counts(buckets), recv_displs(buckets);
+  collective("bucket counts", 2 * buckets * sizeof(int), comm, [&] {
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1,
+                 MPI_INT, comm);
+  });
+  runs.assign(1, 0);
+  for (size_t i = 0; i < buckets; ++i) {
+    recv_displs[i] = static_cast<int>(runs.back());
+    runs.push_back(runs.back() + static_cast<size_t>(recv_counts[i]));
+  }
+  std::vector<Element> bucket(runs.back());
+  collective("bucket exchange", bytes_of(length + bucket.size()), comm, [&] {
+    MPI_Alltoallv(sorted, send_counts.data(), send_displs.data(),
+                  element_type, bucket.data(), recv_counts.data(),
+                  recv_displs.data(), element_type, comm);
+  });
+  return bucket;
+}
+
+// Bucket exchange with splitters from size - 1 regular samples of every
+// rank's sorted block
+std::vector<Element> exchange_buckets(const Element *sorted, size_t length,
+                                      MPI_Comm comm,
+                                      std::vector<size_t> &runs) {
+  int size;
+  MPI_Comm_size(comm, &size);
+  auto splitters = choose_splitters(
+      regular_samples(sorted, length, static_cast<size_t>(size) - 1), comm);
+  return exchange_buckets(sorted, length, splitters, comm, runs);
+}
+
+// merge the sorted runs of `bucket` pairwise, doubling the run length every
+// pass
+void merge_buckets(std::vector<Element> &bucket,
+                   const std::vector<size_t> &runs) {
+  auto count = runs.size() - 1;
+  compute("merge buckets", [&] {
+    for (size_t width = 1; width < count; width *= 2) {
+      for (size_t i = 0; i + width < count; i += 2 * width) {
+        std::inplace_merge(
+            bucket.begin() + runs[i], bucket.begin() + runs[i + width],
+            bucket.begin() + runs[std::min(i + 2 * width, count)]);
+      }
+    }
+  });
+}
+
+// Sample sort of sorted blocks: the bucket exchange and a merge of the
+// received runs. Returns the local bucket, whose size varies between ranks.
+std::vector<Element> sample_sort(const std::vector<Element> &local) {
+  std::vector<size_t> runs;
+  auto bucket =
+      exchange_buckets(local.data(), local.size(), MPI_COMM_WORLD, runs);
+  merge_buckets(bucket, runs);
+  return bucket;
+}
+
+// Local sort stage of the block algorithms: std::sort, or a radix sort with
+// `radix_bits` digits whose passes are stored in `passes` if given.
+void local_sort(std::vector<Element> &local, int radix_bits,
+                std::vector<RadixPass> *passes) {
+  compute("local sort", [&] {
+    if constexpr (std::is_integral_v<Element>) {
+      if (radix_bits != 0) {
+        RadixSort<Element> radix(radix_bits);
+        radix(local.data(), local.size());
+        if (passes) {
+          *passes = radix.passes();
+        }
+        return;
+      }
+    }
+    std::sort(local.begin(), local.end());
+  });
+}
+
+// threads of one rank for the hybrid sort: SORT_THREADS, or the cores of the
+// node shared among its ranks
+int hybrid_threads(int node_size) {
+  if (auto threads = std::getenv("SORT_THREADS")) {
+    return std::max(std::atoi(threads), 1);
+  }
+  auto cores = static_cast<int>(std::thread::hardware_concurrency());
+  return std::max(cores / node_size, 1);
+}
+
+// Hybrid sort. The ranks of a node share one segment allocated with
+// MPI_Win_allocate_shared by the node leader (node rank 0), which receives
+// the node's share of the input. Every rank of the node sorts a slice of the
+// segment in place with a thread pool, then the leader merges the slices with
+// its own pool. Only the leaders take part in the bucket exchange and the
+// final gather, so no message is ever sent between ranks of one node.
+void hybrid_sort(Element *begin, int global_length, int rank) {
+  MPI_Comm node, leaders;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                      MPI_INFO_NULL, &node);
+  int node_rank, node_size;
+  MPI_Comm_rank(node, &node_rank);
+  MPI_Comm_size(node, &node_size);
+  bool leader = 0 == node_rank;
+  MPI_Comm_split(MPI_COMM_WORLD, leader ? 0 : MPI_UNDEFINED, rank, &leaders);
+
+  // balanced shares among the nodes; world rank 0 leads the first node
+  int node_length = 0;
+  std::vector<int> counts, displs;
+  if (leader) {
+    int leader_rank, leader_size;
+    MPI_Comm_rank(leaders, &leader_rank);
+    MPI_Comm_size(leaders, &leader_size);
+    balance(global_length, leader_size, counts, displs);
+    node_length = counts[leader_rank];
+  }
+  collective("node length", sizeof(int), node,
+             [&] { MPI_Bcast(&node_length, 1, MPI_INT, 0, node); });
+
+  Element *segment;
+  MPI_Win window;
+  MPI_Win_allocate_shared(
+      leader ? static_cast<MPI_Aint>(node_length * sizeof(Element)) : 0,
+      sizeof(Element), MPI_INFO_NULL, node, &segment, &window);
+  if (!leader) {
+    MPI_Aint bytes;
+    int unit;
+    MPI_Win_shared_query(window, 0, &bytes, &unit, &segment);
+  }
+  // one passive epoch for the whole sort; a node barrier between two syncs
+  // makes the stores of every rank visible to the others
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+  auto node_sync = [&] {
+    profiler.record(Phase::Idle, "node sync", 0, [&] {
+      MPI_Win_sync(window);
+      MPI_Barrier(node);
+      MPI_Win_sync(window);
+    });
+  };
+
+  if (leader) {
+    collective("scatter", bytes_of(0 == rank ? global_length : node_length),
+               leaders, [&] {
+                 MPI_Scatterv(begin, counts.data(), displs.data(),
+                              element_type, segment, node_length,
+                              element_type, 0, leaders);
+               });
+  }
+  node_sync();
+
+  parallel::ThreadPool pool{hybrid_threads(node_size)};
+  auto slice = share(static_cast<size_t>(node_length), node_rank, node_size);
+  compute("node sort", [&] {
+    parallel_sort(segment + slice.first, slice.second - slice.first, pool);
+  });
+  node_sync();
+
+  if (leader) {
+    std::vector<size_t> bounds;
+    for (int i = 0; i <= node_size; ++i) {
+      bounds.push_back(
+          share(static_cast<size_t>(node_length), i, node_size).first);
+    }
+    std::vector<Element> scratch(static_cast<size_t>(node_length));
+    compute("node merge",
+            [&] { merge_runs(segment, scratch.data(), bounds, pool); });
+
+    std::vector<size_t> runs;
+    auto bucket = exchange_buckets(segment, static_cast<size_t>(node_length),
+                                   leaders, runs);
+    scratch.resize(bucket.size());
+    compute("merge buckets",
+            [&] { merge_runs(bucket.data(), scratch.data(), runs, pool); });
+
+    int count = static_cast<int>(bucket.size());
+    collective("gather counts", sizeof(int) * counts.size(), leaders, [&] {
+      MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, leaders);
+    });
+    for (size_t i = 1; i < counts.size(); ++i) {
+      displs[i] = displs[i - 1] + counts[i - 1];
+    }
+    collective("gather",
+               bytes_of(0 == rank ? static_cast<size_t>(global_length)
+                                  : bucket.size()),
+               leaders, [&] {
+                 MPI_Gatherv(bucket.data(), count, element_type, begin,
+                             counts.data(), displs.data(), element_type, 0,
+                             leaders);
+               });
+    MPI_Comm_free(&leaders);
+  }
+  MPI_Win_unlock_all(window);
+  MPI_Win_free(&window);
+  MPI_Comm_free(&node);
+}
+
+// samples per rank read from the input for the splitters of mpi_sort_file;
+// they come from unsorted stripes, so many more than size - 1 are taken
+constexpr size_t EXTERNAL_SAMPLES = 256;
+
+// smallest buffer of a run in the k-way merge of mpi_sort_file
+constexpr size_t MERGE_BUFFER = 4096;
+
+// byte offset of an element in a file of raw Elements
+MPI_Offset file_offset(size_t element) {
+  return static_cast<MPI_Offset>(element * sizeof(Element));
+}
+
+// add the time of step() to `total`
+template <typename Step> void timed(nanoseconds &total, Step &&step) {
+  auto begin = high_resolution_clock::now();
+  step();
+  total += duration_cast<nanoseconds>(high_resolution_clock::now() - begin);
+}
+
+// information of rank 0 about a sort of `length` elements starting now
+std::unique_ptr<Information> make_information(const Context &context,
+                                              size_t length) {
+  auto information = std::make_unique<Information>();
+  information->length = length;
+  auto res = MPI_Comm_size(MPI_COMM_WORLD, &information->num_of_proc);
+  if (MPI_SUCCESS != res) {
+    throw std::runtime_error("failed to get MPI world size");
+  }
+  information->algorithm = context.algorithm;
+  information->argc = context.argc;
+  for (auto i = 0; i < context.argc; ++i) {
+    information->argv.push_back(context.argv[i]);
+  }
+  information->start = high_resolution_clock::now();
+  return information;
+}
+
+// Collect the phases of every rank on rank 0 into `information` and write
+// the trace of all ranks to `trace` if given.
+void finish_profile(Information *information, const std::string &trace,
+                    int rank, int num_of_proc) {
+  if (!profiler.enabled()) {
+    return;
+  }
+  profiler.stop();
+  auto profile = profiler.profile();
+  profile.dropped_events = profiler.dropped();
+  std::vector<PhaseProfile> phases(0 == rank ? num_of_proc : 0);
+  static_assert(sizeof(PhaseProfile) == 9 * sizeof(uint64_t));
+  MPI_Gather(&profile, 9, MPI_UINT64_T, phases.data(), 9, MPI_UINT64_T, 0,
+             MPI_COMM_WORLD);
+  std::vector<uint64_t> dropped;
+  for (const auto &phase : phases) {
+    dropped.push_back(phase.dropped_events);
+  }
+  if (0 == rank) {
+    information->phases = std::move(phases);
+  }
+  if (trace.empty()) {
+    return;
+  }
+  const auto &events = profiler.events();
+  int bytes = static_cast<int>(events.size() * sizeof(TraceEvent));
+  std::vector<int> counts(num_of_proc), displs(num_of_proc);
+  MPI_Gather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, 0,
+             MPI_COMM_WORLD);
+  for (int i = 1; i < num_of_proc; ++i) {
+    displs[i] = displs[i - 1] + counts[i - 1];
+  }
+  std::vector<TraceEvent> all_events(
+      0 == rank ? static_cast<size_t>(displs.back() + counts.back()) /
+                      sizeof(TraceEvent)
+                : 0);
+  MPI_Gatherv(events.data(), bytes, MPI_BYTE, all_events.data(),
+              counts.data(), displs.data(), MPI_BYTE, 0, MPI_COMM_WORLD);
+  if (0 != rank) {
+    return;
+  }
+  std::vector<std::vector<TraceEvent>> by_rank(num_of_proc);
+  for (int i = 0; i < num_of_proc; ++i) {
+    auto first = all_events.begin() + displs[i] / sizeof(TraceEvent);
+    by_rank[i].assign(first, first + counts[i] / sizeof(TraceEvent));
+  }
+  std::ofstream file{trace};
+  if (!file) {
+    throw std::runtime_error("failed to open " + trace);
+  }
+  write_chrome_trace(by_rank, file, dropped);
+}
+} // namespace
+
 Context::Context(int &argc, char **&argv) : argc(argc), argv(argv) {
   MPI_Init(&argc, &argv);
+  element_type = make_element_type();
+  if (auto name = std::getenv("SORT_ALGORITHM")) {
+    algorithm = parse_algorithm(name);
+  }
+  if (auto bits = std::getenv("SORT_RADIX_BITS")) {
+    radix_bits = std::atoi(bits);
+    if constexpr (std::is_integral_v<Element>) {
+      // fail here rather than in the middle of a sort
+      RadixSort<Element>{radix_bits};
+    }
+  }
+  if (auto rounds = std::getenv("SORT_CHECK_ROUNDS")) {
+    check_rounds = std::atoi(rounds);
+    if (check_rounds < 2) {
+      throw std::runtime_error("SORT_CHECK_ROUNDS must be at least 2");
+    }
+  }
+  if (auto flag = std::getenv("SORT_PROFILE")) {
+    profile = 0 != std::atoi(flag);
+  }
+  if (auto path = std::getenv("SORT_TRACE")) {
+    trace = path;
+  }
+  if (auto length = std::getenv("SORT_RUN_LENGTH")) {
+    run_length = std::atoi(length);
+    if (run_length <= 0) {
+      throw std::runtime_error("SORT_RUN_LENGTH must be positive");
+    }
+  }
 }
 
-Context::~Context() { MPI_Finalize(); }
+Context::~Context() {
+  MPI_Type_free(&element_type);
+  MPI_Finalize();
+}
 
 std::unique_ptr<Information> Context::mpi_sort(Element *begin,
                                                Element *end) const {
@@ -24,22 +608,12 @@ std::unique_ptr<Information> Context::mpi_sort(Element *begin,
   }
 
   if (0 == rank) {
-    information = std::make_unique<Information>();
-    information->length = end - begin;
-    res = MPI_Comm_size(MPI_COMM_WORLD, &information->num_of_proc);
-    if (MPI_SUCCESS != res) {
-      throw std::runtime_error("failed to get MPI world size");
-    };
-    information->argc = argc;
-    for (auto i = 0; i < argc; ++i) {
-      information->argv.push_back(argv[i]);
-    }
-    information->start = high_resolution_clock::now();
+    information = make_information(*this, end - begin);
   }
+  profiler.start(profile, !trace.empty());
 
   {
-    /// now starts the main sorting procedure
-    /// @todo: please modify the following code
+    // now starts the main sorting procedure
 
     // Initialize Local array for each process
     int num_of_proc;
@@ -48,147 +622,201 @@ std::unique_ptr<Information> Context::mpi_sort(Element *begin,
     if (0 == rank) {
       global_length = end - begin;
     }
-    MPI_Bcast(&global_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    collective("length", sizeof(int), MPI_COMM_WORLD, [&] {
+      MPI_Bcast(&global_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    });
 
     // deal with the case that datasize < process amount:
     if (global_length < num_of_proc) {
       if (0 == rank) {
-        std::sort(begin, end);
+        compute("local sort", [&] { std::sort(begin, end); });
+        information->end = high_resolution_clock::now();
+      }
+      finish_profile(information.get(), trace, rank, num_of_proc);
+      return information;
+    }
+
+    if (Algorithm::Hybrid == algorithm) {
+      hybrid_sort(begin, global_length, rank);
+      if (0 == rank) {
         information->end = high_resolution_clock::now();
       }
+      finish_profile(information.get(), trace, rank, num_of_proc);
       return information;
     }
 
-    // ***********************************
-    // Parallel Odd-Even Sort:
-    // Initialize varibles for the bubbling loop
-    int local_length = global_length / num_of_proc; // local array length
-    Element *local_array = (Element *)malloc(
-        sizeof(Element) * local_length); // initialize local array
-    // Scatter input data into each process
-    MPI_Scatter(begin, local_length, MPI_LONG, local_array, local_length,
-                MPI_LONG, 0, MPI_COMM_WORLD);
+    // Parallel Sort:
+    // Balanced blocks: the first global_length % num_of_proc ranks take one
+    // element more, so every element is sorted in parallel
+    std::vector<int> counts, displs;
+    balance(global_length, num_of_proc, counts, displs);
+    int local_length = counts[rank];
+    std::vector<Element> local_array(local_length);
+    collective("scatter", bytes_of(0 == rank ? global_length : local_length),
+               MPI_COMM_WORLD, [&] {
+                 MPI_Scatterv(begin, counts.data(), displs.data(),
+                              element_type, local_array.data(), local_length,
+                              element_type, 0, MPI_COMM_WORLD);
+               });
 
-    // Do Odd-and-Even Sort
-    Element local_buff;
+    switch (algorithm) {
+    case Algorithm::OddEven:
+      odd_even_transposition(local_array.data(), local_length, displs[rank],
+                             global_length, rank, num_of_proc, check_rounds);
+      break;
+    case Algorithm::MergeSplit:
+      local_sort(local_array, radix_bits,
+                 information ? &information->radix_passes : nullptr);
+      block_odd_even(local_array, rank, num_of_proc, global_length);
+      break;
+    case Algorithm::Sample:
+      local_sort(local_array, radix_bits,
+                 information ? &information->radix_passes : nullptr);
+      local_array = sample_sort(local_array);
+      break;
+    case Algorithm::Hybrid: // distributes the input itself, see above
+      break;
+    }
 
-    for (int idx = 0; idx < global_length; ++idx) {
+    // Gather local_array back to global array; sample sort leaves buckets of
+    // different sizes, so the counts are collected first
+    int count = static_cast<int>(local_array.size());
+    collective("gather counts", sizeof(int) * counts.size(), MPI_COMM_WORLD,
+               [&] {
+                 MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0,
+                            MPI_COMM_WORLD);
+               });
+    for (int i = 1; i < num_of_proc; ++i) {
+      displs[i] = displs[i - 1] + counts[i - 1];
+    }
+    collective("gather", bytes_of(0 == rank ? global_length : count),
+               MPI_COMM_WORLD, [&] {
+                 MPI_Gatherv(local_array.data(), count, element_type, begin,
+                             counts.data(), displs.data(), element_type, 0,
+                             MPI_COMM_WORLD);
+               });
+  }
 
-      if (idx % 2 == 0) {
-        // Even-Rank Process Inner Bubbling
-        for (int loc_idx = local_length - 1; loc_idx > 0; loc_idx -= 2) {
-          if (local_array[loc_idx - 1] > local_array[loc_idx]) {
-            std::swap(local_array[loc_idx - 1], local_array[loc_idx]);
-          }
-        }
-      }
+  if (0 == rank) {
+    information->end = high_resolution_clock::now();
+  }
+  int num_of_proc;
+  MPI_Comm_size(MPI_COMM_WORLD, &num_of_proc);
+  finish_profile(information.get(), trace, rank, num_of_proc);
+  return information;
+}
 
-      else {
-        // Odd_rank Process Inner Bubbling
-        for (int loc_idx = local_length - 2; loc_idx > 0; loc_idx -= 2) {
-          if (local_array[loc_idx - 1] > local_array[loc_idx]) {
-            std::swap(local_array[loc_idx - 1], local_array[loc_idx]);
-          }
-        }
+std::unique_ptr<Information>
+Context::mpi_sort_file(const std::string &input,
+                       const std::string &output) const {
+  int rank, num_of_proc;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &num_of_proc);
+  std::unique_ptr<Information> information{};
+  if (0 == rank) {
+    information = make_information(*this, 0);
+    information->algorithm = Algorithm::Sample;
+    information->external = true;
+  }
+  nanoseconds io_time{}, compute_time{};
 
-        // Odd-Phase Communication
-        if (rank % 2 == 1) {
-          local_buff = local_array[0];
-          MPI_Send(&local_buff, 1, MPI_LONG, rank - 1, 0, MPI_COMM_WORLD);
-          MPI_Recv(&local_buff, 1, MPI_LONG, rank - 1, 0, MPI_COMM_WORLD,
-                   MPI_STATUS_IGNORE);
-          if (local_buff > local_array[0]) {
-            std::swap(local_buff, local_array[0]);
-          }
-        } else {
-          if (rank != num_of_proc - 1) {
-            MPI_Recv(&local_buff, 1, MPI_LONG, rank + 1, 0, MPI_COMM_WORLD,
-                     MPI_STATUS_IGNORE);
-            if (local_buff < local_array[local_length - 1]) {
-              std::swap(local_buff, local_array[local_length - 1]);
-            }
-            MPI_Send(&local_buff, 1, MPI_LONG, rank + 1, 0, MPI_COMM_WORLD);
-          }
-        }
+  MPI_File in;
+  if (MPI_SUCCESS != MPI_File_open(MPI_COMM_WORLD, input.c_str(),
+                                   MPI_MODE_RDONLY, MPI_INFO_NULL, &in)) {
+    throw std::runtime_error("failed to open " + input);
+  }
+  MPI_Offset bytes;
+  MPI_File_get_size(in, &bytes);
+  if (bytes % static_cast<MPI_Offset>(sizeof(Element)) != 0) {
+    MPI_File_close(&in);
+    throw std::runtime_error(input + " is not a file of whole elements");
+  }
+  auto global_length = static_cast<size_t>(bytes) / sizeof(Element);
+  if (0 == rank) {
+    information->length = global_length;
+  }
+  auto stripe = share(global_length, rank, num_of_proc);
+  auto stripe_length = stripe.second - stripe.first;
 
-        // Even-Phase Communication
-        if (rank % 2 == 0) {
-          local_buff = local_array[0];
-          int target_rank = (rank == 0) ? MPI_PROC_NULL : rank - 1;
-          MPI_Send(&local_buff, 1, MPI_LONG, target_rank, 0, MPI_COMM_WORLD);
-          MPI_Recv(&local_buff, 1, MPI_LONG, target_rank, 0, MPI_COMM_WORLD,
-                   MPI_STATUS_IGNORE);
-          if (local_buff > local_array[0]) {
-            std::swap(local_buff, local_array[0]);
-          }
-        } else {
-          // Rationale: MUST make sure MPI_Recv will recv a value or local_buff
-          // is the original local array value
-          if (rank != num_of_proc - 1) {
-            MPI_Recv(&local_buff, 1, MPI_LONG, rank + 1, 0, MPI_COMM_WORLD,
-                     MPI_STATUS_IGNORE);
-            if (local_buff < local_array[local_length - 1]) {
-              std::swap(local_buff, local_array[local_length - 1]);
-            }
-
-            MPI_Send(&local_buff, 1, MPI_LONG, rank + 1, 0, MPI_COMM_WORLD);
-          }
-        }
-      }
+  // splitters from samples spread over every stripe
+  std::vector<Element> samples(std::min(stripe_length, EXTERNAL_SAMPLES));
+  timed(io_time, [&] {
+    for (size_t i = 0; i < samples.size(); ++i) {
+      auto at = stripe.first + (i + 1) * stripe_length / (samples.size() + 1);
+      MPI_File_read_at(in, file_offset(at), &samples[i], 1, element_type,
+                       MPI_STATUS_IGNORE);
     }
+  });
+  std::sort(samples.begin(), samples.end());
+  auto splitters = choose_splitters(samples, MPI_COMM_WORLD);
 
-    // Gather local_array back to global array
-    MPI_Gather(local_array, local_length, MPI_LONG, begin, local_length,
-               MPI_LONG, 0, MPI_COMM_WORLD);
-    // ***********************************
-
-    // // ***********************************
-    // To run the sequential version, just de-comment this part and then comment
-    // the parallel part
-    // // ***********************************
-    // // Sequantial Odd-Even Sort
-    // if (0 == rank) {
-    //     bool is_sorted = false;
-    //     while (!is_sorted){
-    //         is_sorted = true;
-
-    //         for (int i = 1; i <= global_length - 2; i = i + 2){
-    //             if (begin[i] > begin[i+1]){
-    //                 std::swap(begin[i], begin[i+1]);
-    //                 is_sorted = false;
-    //             }
-    //         }
-
-    //         for (int i = 0; i <= global_length - 2; i = i + 2){
-    //             if (begin[i] > begin[i+1]){
-    //                 std::swap(begin[i], begin[i+1]);
-    //                 is_sorted = false;
-    //             }
-    //         }
-
-    //     }
-    // }
-    // // ***********************************
-
-    // Residualization Strategy: sort residuals into the original array
-    if (0 == rank) {
-      int residual = global_length % num_of_proc;
-
-      while (residual != 0) {
-        auto iter = residual;
-        while (begin[global_length - iter] < begin[global_length - iter - 1]) {
-          std::swap(begin[global_length - iter],
-                    begin[global_length - iter - 1]);
-          ++iter;
-          if (iter == global_length)
-            break;
-        }
-        --residual;
-      }
+  // run formation: every round each rank sorts the next run_length elements
+  // of its stripe and sends them to the ranks owning their keys, whose
+  // merged receipts become one run on local disk
+  auto chunk = static_cast<size_t>(run_length);
+  unsigned long long rounds = (stripe_length + chunk - 1) / chunk;
+  MPI_Allreduce(MPI_IN_PLACE, &rounds, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX,
+                MPI_COMM_WORLD);
+  RunFile<Element> run_file;
+  std::vector<Element> local;
+  std::vector<size_t> runs;
+  for (unsigned long long round = 0; round < rounds; ++round) {
+    auto first = std::min<size_t>(stripe.first + round * chunk, stripe.second);
+    local.resize(std::min(chunk, stripe.second - first));
+    timed(io_time, [&] {
+      MPI_File_read_at_all(in, file_offset(first), local.data(),
+                           static_cast<int>(local.size()), element_type,
+                           MPI_STATUS_IGNORE);
+    });
+    timed(compute_time, [&] {
+      local_sort(local, radix_bits,
+                 information && 0 == round ? &information->radix_passes
+                                           : nullptr);
+    });
+    auto bucket = exchange_buckets(local.data(), local.size(), splitters,
+                                   MPI_COMM_WORLD, runs);
+    timed(compute_time, [&] { merge_buckets(bucket, runs); });
+    if (!bucket.empty()) {
+      timed(io_time, [&] { run_file.append(bucket.data(), bucket.size()); });
     }
   }
+  MPI_File_close(&in);
+
+  // the key ranges follow each other in rank order
+  unsigned long long count = run_file.elements(), written = 0;
+  MPI_Exscan(&count, &written, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM,
+             MPI_COMM_WORLD);
+  if (0 == rank) {
+    written = 0;
+  }
+  MPI_File out;
+  if (MPI_SUCCESS != MPI_File_open(MPI_COMM_WORLD, output.c_str(),
+                                   MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                                   MPI_INFO_NULL, &out)) {
+    throw std::runtime_error("failed to open " + output);
+  }
+  MPI_File_set_size(out, bytes);
+  auto buffer = std::max(chunk / (run_file.runs() + 1), MERGE_BUFFER);
+  auto io_before = io_time;
+  timed(compute_time, [&] {
+    merge_run_file(
+        run_file, buffer,
+        [&](const Element *data, size_t n) {
+          MPI_File_write_at(out, file_offset(written), data,
+                            static_cast<int>(n), element_type,
+                            MPI_STATUS_IGNORE);
+          written += n;
+        },
+        [&](auto &&block) { timed(io_time, block); });
+  });
+  compute_time -= io_time - io_before;
+  MPI_File_close(&out);
 
+  long long times[2] = {io_time.count(), compute_time.count()}, slowest[2];
+  MPI_Reduce(times, slowest, 2, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
   if (0 == rank) {
+    information->io_time = nanoseconds{slowest[0]};
+    information->compute_time = nanoseconds{slowest[1]};
     information->end = high_resolution_clock::now();
   }
   return information;
@@ -200,12 +828,45 @@ std::ostream &Context::print_information(const Information &info,
   auto duration_count = duration_cast<nanoseconds>(duration).count();
   auto mem_size = static_cast<double>(info.length) * sizeof(Element) / 1024.0 /
                   1024.0 / 1024.0;
+  output << "algorithm: "
+         << algorithm_list[static_cast<int>(info.algorithm)]
+         << (info.external ? " (external)" : "") << std::endl;
   output << "input size: " << info.length << std::endl;
   output << "proc number: " << info.num_of_proc << std::endl;
   output << "duration (ns): " << duration_count << std::endl;
   output << "throughput (gb/s): "
          << mem_size / static_cast<double>(duration_count) * 1'000'000'000.0
          << std::endl;
+  if (info.external) {
+    output << "io time (ns): " << info.io_time.count() << std::endl;
+    output << "compute time (ns): " << info.compute_time.count() << std::endl;
+  }
+  for (size_t rank = 0; rank < info.phases.size(); ++rank) {
+    const auto &phases = info.phases[rank];
+    output << "rank " << rank << " (ns, bytes):";
+    for (int phase = 0; phase < 4; ++phase) {
+      output << ' ' << phase_list[phase] << ' ' << phases.nanoseconds[phase];
+      if (static_cast<int>(Phase::PointToPoint) == phase ||
+          static_cast<int>(Phase::Collective) == phase) {
+        output << ' ' << phases.bytes[phase];
+      }
+    }
+    if (phases.dropped_events > 0) {
+      output << " (" << phases.dropped_events << " trace events dropped)";
+    }
+    output << std::endl;
+  }
+  for (const auto &pass : info.radix_passes) {
+    if (pass.shift < 0) {
+      output << "  radix histogram (gb/s): " << pass.throughput() << std::endl;
+    } else if (pass.skipped) {
+      output << "  radix pass from bit " << pass.shift << ": skipped"
+             << std::endl;
+    } else {
+      output << "  radix pass from bit " << pass.shift
+             << " (gb/s): " << pass.throughput() << std::endl;
+    }
+  }
   return output;
 }
 } // namespace sort
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sort/profile.hpp>
+#include <sort/radix.hpp>
+
+namespace sort {
+using Element = int64_t;
+
+/// distributed sorting algorithm run by Context::mpi_sort
+enum class Algorithm : int {
+  OddEven = 0,    ///< odd-even transposition, one element per exchange
+  MergeSplit = 1, ///< local sort, then odd-even merge-split of whole blocks
+  Sample = 2,     ///< local sort, splitters from regular samples, all-to-all
+  Hybrid = 3,     ///< threaded sort per node, sample sort between nodes
+};
+
+inline const char *const algorithm_list[4] = {"odd-even", "merge-split",
+                                              "sample", "hybrid"};
+
+inline Algorithm parse_algorithm(const std::string &name) {
+  for (int i = 0; i < 4; ++i) {
+    if (name == algorithm_list[i]) {
+      return static_cast<Algorithm>(i);
+    }
+  }
+  throw std::runtime_error("unknown sort algorithm " + name);
+}
+
+/// Information produced by rank 0
+struct Information {
+  std::chrono::high_resolution_clock::time_point start{};
+  std::chrono::high_resolution_clock::time_point end{};
+  size_t length{};
+  int num_of_proc{};
+  int argc{};
+  std::vector<char *> argv{};
+  Algorithm algorithm{};
+  /// passes of the radix local sort on rank 0, empty for std::sort
+  std::vector<RadixPass> radix_passes{};
+  /// sorted from file to file by Context::mpi_sort_file
+  bool external{};
+  /// time of the slowest rank in file and run file i/o, and in sorting and
+  /// merging; the rest of the duration is communication (external sort only)
+  std::chrono::nanoseconds io_time{};
+  std::chrono::nanoseconds compute_time{};
+  /// phases of every rank in rank order, with Context::profile only
+  std::vector<PhaseProfile> phases{};
+};
+
+/// MPI context
+struct Context {
+  int &argc;
+  char **&argv;
+  /// taken from the SORT_ALGORITHM environment variable, odd-even if unset
+  Algorithm algorithm = Algorithm::OddEven;
+  /// digit width of the radix sort used as the local sort of merge-split and
+  /// sample sort, from SORT_RADIX_BITS; 0 keeps std::sort
+  int radix_bits = 0;
+  /// rounds of odd-even transposition between two checks whether the array
+  /// is already sorted, from SORT_CHECK_ROUNDS; at least 2
+  int check_rounds = 8;
+  /// elements a rank sorts in memory at once in mpi_sort_file, from
+  /// SORT_RUN_LENGTH
+  int run_length = 1 << 24;
+  /// record the phases of every rank in mpi_sort for print_information, from
+  /// SORT_PROFILE; costs a barrier before every collective
+  bool profile = false;
+  /// write a Chrome trace JSON of the phases of mpi_sort to this file, from
+  /// SORT_TRACE
+  std::string trace;
+
+  Context(int &argc, char **&argv);
+
+  ~Context();
+
+  /// Sort [begin, end), which only has to be valid on rank 0, with
+  /// `algorithm`. Returns the timing information on rank 0 only.
+  std::unique_ptr<Information> mpi_sort(Element *begin, Element *end) const;
+
+  /// Sort the raw Elements of the binary file `input` into the file `output`
+  /// for inputs beyond the memory of the ranks. Every rank reads its stripe
+  /// of the input with MPI-IO, run_length elements at a time, which are
+  /// sorted and exchanged by the splitters of a sample sort and kept as
+  /// sorted runs on local disk ($TMPDIR). A k-way merge of its runs streams
+  /// the key range of every rank to its place in `output`. Returns the
+  /// timing information on rank 0 only.
+  std::unique_ptr<Information> mpi_sort_file(const std::string &input,
+                                             const std::string &output) const;
+
+  static std::ostream &print_information(const Information &info,
+                                         std::ostream &output);
+};
+} // namespace sort
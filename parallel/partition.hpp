@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <parallel/work_stealing.hpp>
+
+namespace parallel {
+
+/// how the tiles of a domain are dealt to workers ahead of time
+enum class Distribution : int { Block = 0, Cyclic = 1, BlockCyclic = 2 };
+
+inline const char *const distribution_list[3] = {"block", "cyclic",
+                                                "block-cyclic"};
+
+inline Distribution parse_distribution(const std::string &name) {
+  for (int i = 0; i < 3; ++i) {
+    if (name == distribution_list[i]) {
+      return static_cast<Distribution>(i);
+    }
+  }
+  throw std::runtime_error("unknown distribution " + name);
+}
+
+/// Static decomposition of a rows x cols domain. The domain is cut into
+/// tile_rows x tile_cols tiles, numbered row-major, and tile t goes to
+///  - Block:       the worker whose contiguous range of tile indices holds t;
+///                 worker w takes [count * w / workers, count * (w + 1) /
+///                 workers), so the ranges differ by at most one tile and
+///                 the longer ones are spread evenly over the workers;
+///  - Cyclic:      worker t % workers;
+///  - BlockCyclic: worker (t / block) % workers.
+/// With tile_rows = 1 and tile_cols = cols this is a row decomposition. The
+/// domain starts at (row_begin, col_begin), so a sub-rectangle of a larger
+/// domain can be decomposed the same way.
+struct Partition {
+  Distribution distribution = Distribution::Block;
+  int rows = 0, cols = 0;
+  int row_begin = 0, col_begin = 0;
+  int tile_rows = 1, tile_cols = 0; ///< tile_cols <= 0 means whole rows
+  int block = 1;
+  int workers = 1;
+
+  int tiles_per_row() const {
+    auto width = tile_width();
+    return (cols + width - 1) / width;
+  }
+
+  int tile_count() const {
+    auto height = std::max(tile_rows, 1);
+    return tiles_per_row() * ((rows + height - 1) / height);
+  }
+
+  /// decompose `region` instead of [0, rows) x [0, cols)
+  void cover(Tile region) {
+    row_begin = region.row_begin;
+    col_begin = region.col_begin;
+    rows = region.row_end - region.row_begin;
+    cols = region.col_end - region.col_begin;
+  }
+
+  Tile tile(int index) const {
+    auto height = std::max(tile_rows, 1);
+    auto width = tile_width();
+    auto row = index / tiles_per_row() * height;
+    auto col = index % tiles_per_row() * width;
+    return {row_begin + row, row_begin + std::min(row + height, rows),
+            col_begin + col, col_begin + std::min(col + width, cols)};
+  }
+
+  /// call f(tile) for every tile owned by `worker`
+  template <typename F> void for_each_tile(int worker, F &&f) const {
+    auto count = tile_count();
+    switch (distribution) {
+    case Distribution::Block: {
+      auto begin =
+          static_cast<int>(static_cast<long>(count) * worker / workers);
+      auto end =
+          static_cast<int>(static_cast<long>(count) * (worker + 1) / workers);
+      for (int t = begin; t < end; ++t) {
+        f(tile(t));
+      }
+      break;
+    }
+    case Distribution::Cyclic:
+      for (int t = worker; t < count; t += workers) {
+        f(tile(t));
+      }
+      break;
+    case Distribution::BlockCyclic: {
+      auto chunk = std::max(block, 1);
+      for (int first = worker * chunk; first < count;
+           first += workers * chunk) {
+        for (int t = first; t < std::min(first + chunk, count); ++t) {
+          f(tile(t));
+        }
+      }
+      break;
+    }
+    }
+  }
+
+private:
+  int tile_width() const {
+    return tile_cols > 0 ? tile_cols : std::max(cols, 1);
+  }
+};
+
+} // namespace parallel
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <pthread.h>
+#include <type_traits>
+#include <vector>
+
+namespace parallel {
+
+/// Per-phase time of the frames dispatched through a ThreadPool, summed over
+/// `frames` frames.
+struct PhaseTimes {
+  size_t frames = 0;
+  size_t dispatch = 0;  ///< run() entry until the last worker started
+  size_t compute = 0;   ///< busy time of the slowest worker
+  size_t imbalance = 0; ///< slowest minus fastest worker busy time
+  size_t sync = 0;      ///< last worker finished until run() returned
+
+  void report(std::ostream &output) const {
+    auto per_frame = [&](size_t value) {
+      return frames == 0 ? 0 : value / frames;
+    };
+    output << "phases over " << frames << " frames (ns per frame): dispatch "
+           << per_frame(dispatch) << ", compute " << per_frame(compute)
+           << ", imbalance " << per_frame(imbalance) << ", sync "
+           << per_frame(sync) << std::endl;
+  }
+};
+
+/// A fixed set of pthreads that live as long as the pool. `run` publishes a
+/// job and releases all workers through a barrier, then waits on a second
+/// barrier until every worker is done, so a frame costs two barrier crossings
+/// instead of pthread_create/pthread_join per thread. The calling thread acts
+/// as worker 0.
+class ThreadPool {
+public:
+  explicit ThreadPool(int threads) : slots(std::max(threads, 1)) {
+    auto count = static_cast<unsigned>(slots.size());
+    pthread_barrier_init(&start, nullptr, count);
+    pthread_barrier_init(&finish, nullptr, count);
+    tids.resize(slots.size() - 1);
+    for (size_t i = 0; i < slots.size(); ++i) {
+      slots[i].pool = this;
+      slots[i].index = static_cast<int>(i);
+    }
+    for (size_t i = 1; i < slots.size(); ++i) {
+      pthread_create(&tids[i - 1], nullptr, worker_main, &slots[i]);
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    stopping = true;
+    pthread_barrier_wait(&start);
+    for (auto tid : tids) {
+      pthread_join(tid, nullptr);
+    }
+    pthread_barrier_destroy(&start);
+    pthread_barrier_destroy(&finish);
+  }
+
+  int size() const { return static_cast<int>(slots.size()); }
+
+  /// call job(worker) once on every worker and wait until all have returned
+  template <typename Job> void run(Job &&job) {
+    using Callable = std::remove_reference_t<Job>;
+    auto dispatched = clock::now();
+    context = const_cast<void *>(static_cast<const void *>(&job));
+    invoke = [](void *context, int worker) {
+      (*static_cast<Callable *>(context))(worker);
+    };
+    pthread_barrier_wait(&start);
+    execute(0);
+    pthread_barrier_wait(&finish);
+    record(dispatched, clock::now());
+  }
+
+  const PhaseTimes &phases() const { return times; }
+
+  /// print the accumulated phase times and start a new accumulation window
+  void report(std::ostream &output) {
+    times.report(output);
+    times = PhaseTimes{};
+  }
+
+private:
+  using clock = std::chrono::high_resolution_clock;
+
+  struct alignas(64) Slot {
+    ThreadPool *pool;
+    int index;
+    clock::time_point begin, end;
+  };
+
+  static void *worker_main(void *arg) {
+    auto *slot = static_cast<Slot *>(arg);
+    auto *pool = slot->pool;
+    while (true) {
+      pthread_barrier_wait(&pool->start);
+      if (pool->stopping) {
+        break;
+      }
+      pool->execute(slot->index);
+      pthread_barrier_wait(&pool->finish);
+    }
+    return nullptr;
+  }
+
+  void execute(int worker) {
+    auto &slot = slots[worker];
+    slot.begin = clock::now();
+    invoke(context, worker);
+    slot.end = clock::now();
+  }
+
+  void record(clock::time_point dispatched, clock::time_point returned) {
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+    auto ns = [](clock::duration duration) {
+      return static_cast<size_t>(duration_cast<nanoseconds>(duration).count());
+    };
+    auto last_begin = dispatched, last_end = dispatched;
+    auto slowest = clock::duration::zero();
+    auto fastest = clock::duration::max();
+    for (const auto &slot : slots) {
+      last_begin = std::max(last_begin, slot.begin);
+      last_end = std::max(last_end, slot.end);
+      slowest = std::max(slowest, slot.end - slot.begin);
+      fastest = std::min(fastest, slot.end - slot.begin);
+    }
+    times.frames += 1;
+    times.dispatch += ns(last_begin - dispatched);
+    times.compute += ns(slowest);
+    times.imbalance += ns(slowest - fastest);
+    times.sync += ns(returned - last_end);
+  }
+
+  std::vector<Slot> slots;
+  std::vector<pthread_t> tids;
+  pthread_barrier_t start, finish;
+  bool stopping = false;
+  void (*invoke)(void *, int) = nullptr;
+  void *context = nullptr;
+  PhaseTimes times;
+};
+
+} // namespace parallel
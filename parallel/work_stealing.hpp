@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace parallel {
+
+/// rectangle [row_begin, row_end) x [col_begin, col_end) of a 2D domain
+struct Tile {
+  int row_begin, row_end;
+  int col_begin, col_end;
+};
+
+/// Cuts a rows x cols domain into tiles and deals contiguous runs of tile
+/// indices to per-worker deques. A worker pops from the front of its own
+/// deque; once it runs dry it steals the back half of another worker's
+/// deque. Both operations are a single CAS on the victim's packed
+/// (head, tail) pair, so there is no global lock.
+///
+/// `reset` must not race with `next`: call it before the workers start or
+/// while they wait at a barrier.
+class TileScheduler {
+public:
+  void reset(int rows, int cols, int tile_rows, int tile_cols, int workers) {
+    reset({0, rows, 0, cols}, tile_rows, tile_cols, workers);
+  }
+
+  /// schedule the tiles of `region` only
+  void reset(Tile region, int tile_rows, int tile_cols, int workers) {
+    row_begin = region.row_begin;
+    col_begin = region.col_begin;
+    rows = region.row_end - region.row_begin;
+    cols = region.col_end - region.col_begin;
+    this->tile_rows = std::max(tile_rows, 1);
+    this->tile_cols = std::max(tile_cols, 1);
+    tiles_per_row = (cols + this->tile_cols - 1) / this->tile_cols;
+    auto tile_count = tiles_per_row * ((rows + this->tile_rows - 1) /
+                                       this->tile_rows);
+    if (workers != this->workers) {
+      deques = std::make_unique<Deque[]>(workers);
+      this->workers = workers;
+    }
+    for (int w = 0; w < workers; ++w) {
+      auto head = static_cast<uint32_t>(
+          static_cast<int64_t>(tile_count) * w / workers);
+      auto tail = static_cast<uint32_t>(
+          static_cast<int64_t>(tile_count) * (w + 1) / workers);
+      deques[w].bounds.store(pack(head, tail), std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  /// fetch the next tile for `worker`; false once no work is left anywhere
+  bool next(int worker, Tile &tile) {
+    uint32_t index;
+    if (!pop(worker, index) && !steal(worker, index)) {
+      return false;
+    }
+    auto row = static_cast<int>(index) / tiles_per_row * tile_rows;
+    auto col = static_cast<int>(index) % tiles_per_row * tile_cols;
+    tile = {row_begin + row, row_begin + std::min(row + tile_rows, rows),
+            col_begin + col, col_begin + std::min(col + tile_cols, cols)};
+    return true;
+  }
+
+private:
+  struct alignas(64) Deque {
+    std::atomic<uint64_t> bounds{0};
+  };
+
+  static uint64_t pack(uint32_t head, uint32_t tail) {
+    return static_cast<uint64_t>(tail) << 32 | head;
+  }
+  static uint32_t head_of(uint64_t bounds) {
+    return static_cast<uint32_t>(bounds);
+  }
+  static uint32_t tail_of(uint64_t bounds) {
+    return static_cast<uint32_t>(bounds >> 32);
+  }
+
+  bool pop(int worker, uint32_t &index) {
+    auto &bounds = deques[worker].bounds;
+    auto current = bounds.load(std::memory_order_acquire);
+    while (head_of(current) < tail_of(current)) {
+      if (bounds.compare_exchange_weak(
+              current, pack(head_of(current) + 1, tail_of(current)),
+              std::memory_order_acq_rel, std::memory_order_acquire)) {
+        index = head_of(current);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Tile indices are handed out once per reset, so a (head, tail) pair is
+  // never reused within a frame and the CAS cannot suffer from ABA.
+  bool steal(int worker, uint32_t &index) {
+    for (int offset = 1; offset < workers; ++offset) {
+      auto &bounds = deques[(worker + offset) % workers].bounds;
+      auto current = bounds.load(std::memory_order_acquire);
+      while (head_of(current) < tail_of(current)) {
+        auto head = head_of(current);
+        auto tail = tail_of(current);
+        auto split = head + (tail - head) / 2;
+        if (bounds.compare_exchange_weak(current, pack(head, split),
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+          // own deque is empty, so nobody else can be modifying it
+          deques[worker].bounds.store(pack(split + 1, tail),
+                                      std::memory_order_release);
+          index = split;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  int row_begin = 0, col_begin = 0;
+  int rows = 0, cols = 0;
+  int tile_rows = 1, tile_cols = 1;
+  int tiles_per_row = 0;
+  int workers = 0;
+  std::unique_ptr<Deque[]> deques;
+};
+
+} // namespace parallel
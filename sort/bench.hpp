@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <odd-even-sort.hpp>
+
+namespace sort {
+
+/// input generated by the sort benchmark
+enum class Distribution : int {
+  Uniform = 0,      ///< independent values over the whole Element range
+  Sorted = 1,       ///< ascending
+  Reverse = 2,      ///< descending
+  FewUnique = 3,    ///< FEW_UNIQUE distinct values in random order
+  Zipf = 4,         ///< Zipf(s = 1) draws from ZIPF_VALUES distinct values
+  NearlySorted = 5, ///< ascending with NEARLY_SORTED_SWAPS of n pairs swapped
+};
+
+inline const char *const distribution_list[6] = {
+    "uniform", "sorted", "reverse", "few-unique", "zipf", "nearly-sorted"};
+
+inline Distribution parse_distribution(const std::string &name) {
+  for (int i = 0; i < 6; ++i) {
+    if (name == distribution_list[i]) {
+      return static_cast<Distribution>(i);
+    }
+  }
+  throw std::runtime_error("unknown input distribution " + name);
+}
+
+inline constexpr size_t FEW_UNIQUE = 16;
+inline constexpr size_t ZIPF_VALUES = 1 << 16;
+inline constexpr double NEARLY_SORTED_SWAPS = 0.01;
+
+/// n elements of `distribution`, the same for the same seed
+inline std::vector<Element> generate(Distribution distribution, size_t n,
+                                     uint64_t seed) {
+  std::mt19937_64 random{seed};
+  std::vector<Element> data(n);
+  auto draw = [&] { return static_cast<Element>(random()); };
+  switch (distribution) {
+  case Distribution::Uniform:
+    std::generate(data.begin(), data.end(), draw);
+    break;
+  case Distribution::Sorted:
+  case Distribution::NearlySorted:
+    for (size_t i = 0; i < n; ++i) {
+      data[i] = static_cast<Element>(i);
+    }
+    if (Distribution::NearlySorted == distribution && n > 1) {
+      std::uniform_int_distribution<size_t> index{0, n - 1};
+      auto swaps = static_cast<size_t>(static_cast<double>(n) *
+                                       NEARLY_SORTED_SWAPS);
+      for (size_t i = 0; i < swaps; ++i) {
+        std::swap(data[index(random)], data[index(random)]);
+      }
+    }
+    break;
+  case Distribution::Reverse:
+    for (size_t i = 0; i < n; ++i) {
+      data[i] = static_cast<Element>(n - i);
+    }
+    break;
+  case Distribution::FewUnique: {
+    std::vector<Element> values(FEW_UNIQUE);
+    std::generate(values.begin(), values.end(), draw);
+    std::uniform_int_distribution<size_t> pick{0, FEW_UNIQUE - 1};
+    for (auto &x : data) {
+      x = values[pick(random)];
+    }
+    break;
+  }
+  case Distribution::Zipf: {
+    // inverse transform over the cumulative weights 1 / rank; the ranks map
+    // to random values, so frequent values are not the smallest ones
+    std::vector<double> cumulative(ZIPF_VALUES);
+    double total = 0.0;
+    for (size_t rank = 0; rank < ZIPF_VALUES; ++rank) {
+      total += 1.0 / static_cast<double>(rank + 1);
+      cumulative[rank] = total;
+    }
+    std::vector<Element> values(ZIPF_VALUES);
+    std::generate(values.begin(), values.end(), draw);
+    std::uniform_real_distribution<double> uniform{0.0, total};
+    for (auto &x : data) {
+      auto rank = std::upper_bound(cumulative.begin(), cumulative.end(),
+                                   uniform(random)) -
+                  cumulative.begin();
+      x = values[std::min(static_cast<size_t>(rank), ZIPF_VALUES - 1)];
+    }
+    break;
+  }
+  }
+  return data;
+}
+
+/// Order-independent checksum of a multiset of elements: the sum and the xor
+/// of a 64-bit mix of every element. A sort must keep it unchanged.
+struct Checksum {
+  uint64_t sum = 0;
+  uint64_t bits = 0;
+
+  Checksum() = default;
+
+  Checksum(const Element *begin, const Element *end) { add(begin, end); }
+
+  /// take [begin, end) into the checksum as well
+  void add(const Element *begin, const Element *end) {
+    for (auto *x = begin; x != end; ++x) {
+      auto h = mix(static_cast<uint64_t>(*x));
+      sum += h;
+      bits ^= h;
+    }
+  }
+
+  bool operator==(const Checksum &other) const {
+    return sum == other.sum && bits == other.bits;
+  }
+
+private:
+  // splitmix64 finalizer
+  static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+};
+
+/// order and checksum of a file of raw Elements
+struct FileCheck {
+  size_t length = 0;
+  bool sorted = true; ///< in ascending order
+  Checksum checksum;
+};
+
+/// Check the file of raw Elements at `path`, read `block` elements at a
+/// time, so files beyond the memory of a rank can be checked.
+inline FileCheck check_file(const std::string &path, size_t block = 1 << 20) {
+  std::ifstream file{path, std::ios::binary};
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  FileCheck check;
+  std::vector<Element> buffer(block);
+  bool first = true;
+  Element last{};
+  while (file) {
+    file.read(reinterpret_cast<char *>(buffer.data()),
+              static_cast<std::streamsize>(block * sizeof(Element)));
+    auto count = static_cast<size_t>(file.gcount()) / sizeof(Element);
+    if (count == 0) {
+      break;
+    }
+    check.length += count;
+    check.checksum.add(buffer.data(), buffer.data() + count);
+    // the order also has to hold across the blocks
+    if (!first && buffer[0] < last) {
+      check.sorted = false;
+    }
+    check.sorted = check.sorted &&
+                   std::is_sorted(buffer.begin(), buffer.begin() + count);
+    last = buffer[count - 1];
+    first = false;
+  }
+  return check;
+}
+
+/// parameters of the sort benchmark
+struct SortBenchOptions {
+  std::vector<size_t> sizes{1 << 16, 1 << 20};
+  std::vector<Distribution> distributions{
+      Distribution::Uniform, Distribution::Sorted,
+      Distribution::Reverse, Distribution::FewUnique,
+      Distribution::Zipf,    Distribution::NearlySorted};
+  std::vector<Algorithm> algorithms{Algorithm::OddEven, Algorithm::MergeSplit,
+                                    Algorithm::Sample, Algorithm::Hybrid};
+  int repetitions = 3;
+  uint64_t seed = 4005;
+  /// odd-even transposition takes n rounds, so larger inputs skip it
+  size_t odd_even_limit = 1 << 16;
+  std::string csv;  ///< write the results as CSV to this file
+  std::string json; ///< write the results as JSON to this file
+  /// with both, sort the file of raw Elements `input` into `output` with
+  /// Context::mpi_sort_file (run length from SORT_RUN_LENGTH) instead of the
+  /// generated inputs
+  std::string input, output;
+};
+
+inline const char *sort_bench_usage() {
+  return "usage: [--help] [--sizes N,N,...] [--distributions "
+         "uniform,sorted,reverse,few-unique,zipf,nearly-sorted] "
+         "[--algorithms odd-even,merge-split,sample,hybrid] "
+         "[--repetitions N] [--seed N] [--odd-even-limit N] "
+         "[--csv FILE] [--json FILE] [--input FILE --output FILE]";
+}
+
+/// Parse the command line; options not mentioned keep their values. Returns
+/// false if --help or -h is given, so the caller prints the usage instead.
+inline bool parse_sort_bench_options(int argc, char **argv,
+                                     SortBenchOptions &options) {
+  auto number = [](const char *flag, const std::string &text) {
+    char *last = nullptr;
+    auto value = std::strtoull(text.c_str(), &last, 10);
+    if (text.empty() || *last != '\0') {
+      throw std::runtime_error(std::string{"invalid value for "} + flag +
+                               "\n" + sort_bench_usage());
+    }
+    return static_cast<uint64_t>(value);
+  };
+  // comma separated items, parsed one by one
+  auto list = [](const std::string &text, auto &&parse) {
+    std::vector<decltype(parse(text))> items;
+    size_t first = 0;
+    while (first <= text.size()) {
+      auto last = std::min(text.find(',', first), text.size());
+      items.push_back(parse(text.substr(first, last - first)));
+      first = last + 1;
+    }
+    return items;
+  };
+  for (int i = 1; i < argc; ++i) {
+    std::string flag = argv[i];
+    if (flag == "--help" || flag == "-h") {
+      return false;
+    }
+    if (i + 1 >= argc) {
+      throw std::runtime_error("missing value for " + flag + "\n" +
+                               sort_bench_usage());
+    }
+    std::string value = argv[++i];
+    if (flag == "--sizes") {
+      options.sizes = list(value, [&](const std::string &item) {
+        auto size = number("--sizes", item);
+        // mpi_sort counts the elements in an int
+        if (size > static_cast<uint64_t>(INT_MAX)) {
+          throw std::runtime_error("invalid value for --sizes, at most " +
+                                   std::to_string(INT_MAX) + "\n" +
+                                   sort_bench_usage());
+        }
+        return static_cast<size_t>(size);
+      });
+    } else if (flag == "--distributions") {
+      options.distributions = list(value, parse_distribution);
+    } else if (flag == "--algorithms") {
+      options.algorithms = list(value, parse_algorithm);
+    } else if (flag == "--repetitions") {
+      options.repetitions =
+          static_cast<int>(std::max<uint64_t>(number("--repetitions", value),
+                                              1));
+    } else if (flag == "--seed") {
+      options.seed = number("--seed", value);
+    } else if (flag == "--odd-even-limit") {
+      options.odd_even_limit =
+          static_cast<size_t>(number("--odd-even-limit", value));
+    } else if (flag == "--csv") {
+      options.csv = value;
+    } else if (flag == "--json") {
+      options.json = value;
+    } else if (flag == "--input") {
+      options.input = value;
+    } else if (flag == "--output") {
+      options.output = value;
+    } else {
+      throw std::runtime_error("unknown option " + flag + "\n" +
+                               sort_bench_usage());
+    }
+  }
+  if (options.input.empty() != options.output.empty()) {
+    throw std::runtime_error(std::string{"--input and --output go together\n"} +
+                             sort_bench_usage());
+  }
+  if (!options.input.empty() &&
+      (!options.csv.empty() || !options.json.empty())) {
+    throw std::runtime_error(
+        std::string{"--csv and --json only cover the generated inputs\n"} +
+        sort_bench_usage());
+  }
+  return true;
+}
+
+/// one timed sort of the benchmark
+struct SortBenchResult {
+  Algorithm algorithm{};
+  Distribution distribution{};
+  size_t size{};
+  int num_of_proc{};
+  int repetition{};
+  long long nanoseconds{};
+  bool sorted{};      ///< the output is in ascending order
+  bool permutation{}; ///< the output has the checksum of the input
+
+  /// GiB per second, as print_information
+  double throughput() const {
+    return static_cast<double>(size) * sizeof(Element) / 1024.0 / 1024.0 /
+           1024.0 / static_cast<double>(nanoseconds) * 1e9;
+  }
+
+  bool passed() const { return sorted && permutation; }
+};
+
+inline void write_csv(const std::vector<SortBenchResult> &results,
+                      std::ostream &output) {
+  output << "algorithm,distribution,size,proc,repetition,nanoseconds,"
+            "throughput,sorted,permutation\n";
+  for (const auto &result : results) {
+    output << algorithm_list[static_cast<int>(result.algorithm)] << ','
+           << distribution_list[static_cast<int>(result.distribution)] << ','
+           << result.size << ',' << result.num_of_proc << ','
+           << result.repetition << ',' << result.nanoseconds << ','
+           << result.throughput() << ',' << result.sorted << ','
+           << result.permutation << '\n';
+  }
+}
+
+inline void write_json(const std::vector<SortBenchResult> &results,
+                       std::ostream &output) {
+  output << "[\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto &result = results[i];
+    output << "  {\"algorithm\": \""
+           << algorithm_list[static_cast<int>(result.algorithm)]
+           << "\", \"distribution\": \""
+           << distribution_list[static_cast<int>(result.distribution)]
+           << "\", \"size\": " << result.size
+           << ", \"proc\": " << result.num_of_proc
+           << ", \"repetition\": " << result.repetition
+           << ", \"nanoseconds\": " << result.nanoseconds
+           << ", \"throughput\": " << result.throughput()
+           << ", \"sorted\": " << (result.sorted ? "true" : "false")
+           << ", \"permutation\": " << (result.permutation ? "true" : "false")
+           << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+  }
+  output << "]\n";
+}
+
+} // namespace sort
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace sort {
+
+/// Sorted runs of T spilled to an unlinked temporary file, appended one after
+/// another. The file lives in $TMPDIR (or /tmp), which should be local disk,
+/// and disappears with the object.
+template <typename T> class RunFile {
+public:
+  RunFile() {
+    auto *directory = std::getenv("TMPDIR");
+    auto path = std::string{directory ? directory : "/tmp"} +
+                "/sort-runs-XXXXXX";
+    fd = ::mkstemp(path.data());
+    if (fd < 0) {
+      throw std::runtime_error("cannot create a run file in " + path + ": " +
+                               std::strerror(errno));
+    }
+    ::unlink(path.c_str());
+  }
+
+  RunFile(const RunFile &) = delete;
+  RunFile &operator=(const RunFile &) = delete;
+
+  ~RunFile() { ::close(fd); }
+
+  /// store a sorted run of `count` elements
+  void append(const T *data, size_t count) {
+    transfer(::pwrite, const_cast<T *>(data), bounds.back(), count);
+    bounds.push_back(bounds.back() + count);
+  }
+
+  size_t runs() const { return bounds.size() - 1; }
+  size_t elements() const { return bounds.back(); }
+  size_t run_length(size_t run) const {
+    return bounds[run + 1] - bounds[run];
+  }
+
+  /// read `count` elements of `run`, starting at element `offset` of the run
+  void read(size_t run, size_t offset, T *data, size_t count) const {
+    transfer(::pread, data, bounds[run] + offset, count);
+  }
+
+private:
+  template <typename Io>
+  void transfer(Io io, T *data, size_t element, size_t count) const {
+    auto *bytes = reinterpret_cast<char *>(data);
+    auto left = count * sizeof(T);
+    auto offset = static_cast<off_t>(element * sizeof(T));
+    while (left > 0) {
+      auto done = io(fd, bytes, left, offset);
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+      if (done <= 0) {
+        throw std::runtime_error(std::string{"run file i/o failed: "} +
+                                 (done < 0 ? std::strerror(errno) : "eof"));
+      }
+      bytes += done;
+      offset += done;
+      left -= static_cast<size_t>(done);
+    }
+  }
+
+  int fd;
+  std::vector<size_t> bounds{0};
+};
+
+/// K-way merge of all runs of `file` through a min-heap of run heads. Every
+/// run is read through its own buffer of `buffer_elements`, and the output is
+/// handed to `sink(const T *data, size_t count)` in blocks of the same size,
+/// so memory stays at (runs + 1) * buffer_elements whatever the file size.
+/// `io` wraps every read and write of blocks, e.g. to time them.
+template <typename T, typename Sink, typename Io>
+void merge_run_file(const RunFile<T> &file, size_t buffer_elements,
+                    Sink &&sink, Io &&io) {
+  struct Cursor {
+    std::vector<T> buffer;
+    size_t position = 0; ///< next element of the buffer
+    size_t consumed = 0; ///< elements of the run read into buffers so far
+  };
+  std::vector<Cursor> cursors(file.runs());
+  auto refill = [&](size_t run) {
+    auto &cursor = cursors[run];
+    auto count = std::min(buffer_elements,
+                          file.run_length(run) - cursor.consumed);
+    cursor.buffer.resize(count);
+    cursor.position = 0;
+    io([&] { file.read(run, cursor.consumed, cursor.buffer.data(), count); });
+    cursor.consumed += count;
+    return count > 0;
+  };
+  using Head = std::pair<T, size_t>; // value, run
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+  for (size_t run = 0; run < cursors.size(); ++run) {
+    if (refill(run)) {
+      heads.push({cursors[run].buffer[0], run});
+    }
+  }
+  std::vector<T> output;
+  output.reserve(buffer_elements);
+  while (!heads.empty()) {
+    auto [value, run] = heads.top();
+    heads.pop();
+    output.push_back(value);
+    if (output.size() == buffer_elements) {
+      io([&] { sink(output.data(), output.size()); });
+      output.clear();
+    }
+    auto &cursor = cursors[run];
+    if (++cursor.position < cursor.buffer.size() || refill(run)) {
+      heads.push({cursor.buffer[cursor.position], run});
+    }
+  }
+  if (!output.empty()) {
+    io([&] { sink(output.data(), output.size()); });
+  }
+}
+
+} // namespace sort
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <parallel/thread_pool.hpp>
+
+namespace sort {
+
+/// [begin, end) of the share of `worker` when n items are split evenly
+inline std::pair<size_t, size_t> share(size_t n, int worker, int workers) {
+  auto w = static_cast<size_t>(worker), count = static_cast<size_t>(workers);
+  return {n * w / count, n * (w + 1) / count};
+}
+
+/// Number of elements of sorted `a` among the first k elements of the stable
+/// merge of `a` and `b` (merge path co-rank).
+template <typename T>
+size_t co_rank(size_t k, const T *a, size_t a_length, const T *b,
+               size_t b_length) {
+  size_t low = k > b_length ? k - b_length : 0;
+  size_t high = std::min(k, a_length);
+  while (low < high) {
+    auto middle = low + (high - low) / 2;
+    if (a[middle] <= b[k - middle - 1]) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/// Merge the sorted runs [bounds[i], bounds[i + 1]) of data into one sorted
+/// array, pairwise, so a pass halves the number of runs. Every merge of a
+/// pass is cut into equal output pieces by co_rank, so all workers stay busy
+/// even when only one pair is left. `scratch` holds bounds.back() elements.
+template <typename T>
+void merge_runs(T *data, T *scratch, std::vector<size_t> bounds,
+                parallel::ThreadPool &pool) {
+  auto *from = data, *to = scratch;
+  while (bounds.size() > 2) {
+    std::vector<size_t> merged{0};
+    for (size_t run = 0; run + 1 < bounds.size(); run += 2) {
+      merged.push_back(bounds[std::min(run + 2, bounds.size() - 1)]);
+    }
+    pool.run([&](int worker) {
+      for (size_t run = 0; run + 1 < bounds.size(); run += 2) {
+        auto first = bounds[run], middle = bounds[run + 1];
+        auto last = bounds[std::min(run + 2, bounds.size() - 1)];
+        auto *a = from + first, *b = from + middle;
+        auto a_length = middle - first, b_length = last - middle;
+        auto piece = share(last - first, worker, pool.size());
+        auto i0 = co_rank(piece.first, a, a_length, b, b_length);
+        auto i1 = co_rank(piece.second, a, a_length, b, b_length);
+        std::merge(a + i0, a + i1, b + (piece.first - i0),
+                   b + (piece.second - i1), to + first + piece.first);
+      }
+    });
+    std::swap(from, to);
+    bounds.swap(merged);
+  }
+  if (from != data) {
+    std::copy(from, from + bounds.back(), data);
+  }
+}
+
+/// Merge sort on a thread pool: every worker sorts a share, then the shares
+/// are merged by merge_runs.
+template <typename T>
+void parallel_merge_sort(T *data, size_t n, parallel::ThreadPool &pool) {
+  std::vector<size_t> bounds;
+  for (int worker = 0; worker < pool.size(); ++worker) {
+    bounds.push_back(share(n, worker, pool.size()).first);
+  }
+  bounds.push_back(n);
+  pool.run([&](int worker) {
+    std::sort(data + bounds[worker], data + bounds[worker + 1]);
+  });
+  std::vector<T> scratch(n);
+  merge_runs(data, scratch.data(), bounds, pool);
+}
+
+/// LSD radix sort of integers on a thread pool, one byte per pass. Each pass
+/// counts the digits of every worker's share, turns the counts into one output
+/// offset per (digit, worker) and scatters the shares in parallel, which keeps
+/// the sort stable. Signed keys flip their sign bit to sort as unsigned.
+template <typename T>
+void parallel_radix_sort(T *data, size_t n, parallel::ThreadPool &pool) {
+  static_assert(std::is_integral_v<T>, "radix sort needs integer keys");
+  using Key = std::make_unsigned_t<T>;
+  constexpr int BITS = 8, DIGITS = 1 << BITS;
+  constexpr Key BIAS = std::is_signed_v<T>
+                           ? Key{1} << (std::numeric_limits<Key>::digits - 1)
+                           : Key{0};
+  auto workers = static_cast<size_t>(pool.size());
+  std::vector<std::array<size_t, DIGITS>> offsets(workers);
+  std::vector<T> scratch(n);
+  auto *from = data, *to = scratch.data();
+  for (int shift = 0; shift < std::numeric_limits<Key>::digits;
+       shift += BITS) {
+    auto digit = [&](T value) {
+      return static_cast<size_t>(
+          ((static_cast<Key>(value) ^ BIAS) >> shift) & (DIGITS - 1));
+    };
+    pool.run([&](int worker) {
+      auto &count = offsets[worker];
+      count.fill(0);
+      auto range = share(n, worker, pool.size());
+      for (auto i = range.first; i < range.second; ++i) {
+        ++count[digit(from[i])];
+      }
+    });
+    size_t total = 0;
+    for (size_t d = 0; d < DIGITS; ++d) {
+      for (auto &count : offsets) {
+        auto next = total + count[d];
+        count[d] = total;
+        total = next;
+      }
+    }
+    pool.run([&](int worker) {
+      auto &offset = offsets[worker];
+      auto range = share(n, worker, pool.size());
+      for (auto i = range.first; i < range.second; ++i) {
+        to[offset[digit(from[i])]++] = from[i];
+      }
+    });
+    std::swap(from, to);
+  }
+  if (from != data) {
+    std::copy(from, from + n, data);
+  }
+}
+
+/// radix sort for integer elements, merge sort for anything else
+template <typename T>
+void parallel_sort(T *data, size_t n, parallel::ThreadPool &pool) {
+  if constexpr (std::is_integral_v<T>) {
+    parallel_radix_sort(data, n, pool);
+  } else {
+    parallel_merge_sort(data, n, pool);
+  }
+}
+
+} // namespace sort
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+namespace sort {
+
+/// what a rank spends its time on during a sort
+enum class Phase : int {
+  Compute = 0,      ///< local sorting, merging and compare-swaps
+  PointToPoint = 1, ///< sends and receives between two ranks
+  Collective = 2,   ///< scatter, gather, all-to-all and the like
+  Idle = 3,         ///< waiting for the slowest rank before a collective
+};
+
+inline const char *const phase_list[4] = {"compute", "p2p", "collective",
+                                          "idle"};
+
+/// time and bytes moved of one rank in every phase
+struct PhaseProfile {
+  uint64_t nanoseconds[4] = {};
+  uint64_t bytes[4] = {}; ///< sent plus received, zero for compute and idle
+  uint64_t dropped_events = 0; ///< trace events past Profiler::MAX_EVENTS
+};
+
+/// one timed step of a rank, as a Chrome trace "complete" event
+struct TraceEvent {
+  char name[24] = {};
+  int32_t phase = 0;
+  int64_t begin = 0; ///< ns since the profiler started
+  int64_t duration = 0;
+};
+
+/// Records the phases of one rank. While disabled, record() only runs the
+/// step, so the instrumented code costs nothing outside of profiling runs.
+class Profiler {
+public:
+  /// maximum events kept per rank; odd-even rounds alone could make millions
+  static constexpr size_t MAX_EVENTS = 1 << 16;
+
+  /// forget everything recorded; events are only kept with `trace`
+  void start(bool enabled, bool trace) {
+    active = enabled || trace;
+    tracing = trace;
+    totals = {};
+    trace_events.clear();
+    dropped_events = 0;
+    origin = std::chrono::steady_clock::now();
+  }
+
+  void stop() { active = tracing = false; }
+
+  bool enabled() const { return active; }
+
+  /// run step() as a `phase` step moving `bytes`
+  template <typename Step>
+  void record(Phase phase, const char *name, size_t bytes, Step &&step) {
+    if (!active) {
+      step();
+      return;
+    }
+    using namespace std::chrono;
+    auto begin = steady_clock::now();
+    step();
+    auto end = steady_clock::now();
+    auto index = static_cast<int>(phase);
+    totals.nanoseconds[index] += static_cast<uint64_t>(
+        duration_cast<nanoseconds>(end - begin).count());
+    totals.bytes[index] += bytes;
+    if (!tracing) {
+      return;
+    }
+    if (trace_events.size() == MAX_EVENTS) {
+      ++dropped_events;
+      return;
+    }
+    TraceEvent event;
+    std::strncpy(event.name, name, sizeof(event.name) - 1);
+    event.phase = index;
+    event.begin = duration_cast<nanoseconds>(begin - origin).count();
+    event.duration = duration_cast<nanoseconds>(end - begin).count();
+    trace_events.push_back(event);
+  }
+
+  const PhaseProfile &profile() const { return totals; }
+  const std::vector<TraceEvent> &events() const { return trace_events; }
+  size_t dropped() const { return dropped_events; }
+
+private:
+  bool active = false;
+  bool tracing = false;
+  PhaseProfile totals;
+  std::vector<TraceEvent> trace_events;
+  size_t dropped_events = 0;
+  std::chrono::steady_clock::time_point origin;
+};
+
+/// Write the events of all ranks, `events[rank]`, as a Chrome trace JSON
+/// (chrome://tracing, Perfetto) with one thread per rank. A rank that had to
+/// drop events, `dropped[rank]`, says so in its thread name, since its trace
+/// ends early.
+inline void
+write_chrome_trace(const std::vector<std::vector<TraceEvent>> &events,
+                   std::ostream &output,
+                   const std::vector<uint64_t> &dropped = {}) {
+  output << "{\"traceEvents\": [\n";
+  bool first = true;
+  for (size_t rank = 0; rank < events.size(); ++rank) {
+    output << (first ? "" : ",\n")
+           << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+              "\"tid\": "
+           << rank << ", \"args\": {\"name\": \"rank " << rank;
+    if (rank < dropped.size() && dropped[rank] > 0) {
+      output << " (" << dropped[rank] << " events dropped)";
+    }
+    output << "\"}}";
+    first = false;
+    for (const auto &event : events[rank]) {
+      output << ",\n  {\"name\": \"" << event.name << "\", \"cat\": \""
+             << phase_list[event.phase] << "\", \"ph\": \"X\", \"pid\": 0, "
+             << "\"tid\": " << rank
+             << ", \"ts\": " << static_cast<double>(event.begin) / 1000.0
+             << ", \"dur\": " << static_cast<double>(event.duration) / 1000.0
+             << '}';
+    }
+  }
+  output << "\n]}\n";
+}
+
+} // namespace sort
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SORT_X86 1
+#endif
+
+namespace sort {
+
+/// time and volume of one pass over the keys of a RadixSort
+struct RadixPass {
+  int shift = 0;        ///< lowest key bit of the digit, -1 for the histogram
+  bool skipped = false; ///< every key had the same digit, nothing moved
+  size_t bytes = 0;     ///< bytes read plus bytes written
+  size_t nanoseconds = 0;
+
+  /// GiB per second, as the throughput line of print_information
+  double throughput() const {
+    return nanoseconds == 0 ? 0.0
+                            : static_cast<double>(bytes) / 1024.0 / 1024.0 /
+                                  1024.0 /
+                                  static_cast<double>(nanoseconds) * 1e9;
+  }
+};
+
+/// LSD radix sort of integer keys with 8, 11 or 16-bit digits.
+///
+/// A single read pass counts the digits of all passes at once; a pass whose
+/// digit is the same for every key (one count equals the length) is skipped
+/// without touching the keys, which is common for keys of a narrow range.
+/// With AVX2 the histogram pass extracts the digits of four 64-bit keys per
+/// instruction. Signed keys flip their sign bit to sort as unsigned.
+template <typename T> class RadixSort {
+  static_assert(std::is_integral_v<T>, "radix sort needs integer keys");
+  using Key = std::make_unsigned_t<T>;
+  static constexpr int KEY_BITS = std::numeric_limits<Key>::digits;
+  static constexpr Key BIAS =
+      std::is_signed_v<T> ? Key{1} << (KEY_BITS - 1) : Key{0};
+
+public:
+  explicit RadixSort(int digit_bits = 8)
+      : bits(digit_bits), digits(size_t{1} << digit_bits),
+        pass_count((KEY_BITS + digit_bits - 1) / digit_bits) {
+    if (digit_bits != 8 && digit_bits != 11 && digit_bits != 16) {
+      throw std::runtime_error("radix digits must have 8, 11 or 16 bits");
+    }
+  }
+
+  int digit_bits() const { return bits; }
+
+  /// sort [data, data + n); the passes of this call replace the last ones
+  void operator()(T *data, size_t n) {
+    records.clear();
+    counts.assign(static_cast<size_t>(pass_count) * digits, 0);
+    scratch.resize(n);
+    record(-1, false, n * sizeof(T), [&] { histogram(data, n); });
+    auto *from = data, *to = scratch.data();
+    for (int pass = 0; pass < pass_count; ++pass) {
+      auto *count = &counts[static_cast<size_t>(pass) * digits];
+      auto shift = pass * bits;
+      if (std::find(count, count + digits, n) != count + digits) {
+        record(shift, true, 0, [] {});
+        continue;
+      }
+      record(shift, false, 2 * n * sizeof(T), [&] {
+        size_t offset = 0;
+        for (size_t d = 0; d < digits; ++d) {
+          auto next = offset + count[d];
+          count[d] = offset;
+          offset = next;
+        }
+        for (size_t i = 0; i < n; ++i) {
+          to[count[digit(from[i], shift)]++] = from[i];
+        }
+      });
+      std::swap(from, to);
+    }
+    if (from != data) {
+      std::copy(from, from + n, data);
+    }
+  }
+
+  /// histogram pass first, then one entry per digit, lowest digit first
+  const std::vector<RadixPass> &passes() const { return records; }
+
+private:
+  size_t digit(T value, int shift) const {
+    return static_cast<size_t>(((static_cast<Key>(value) ^ BIAS) >> shift) &
+                               (digits - 1));
+  }
+
+  template <typename Pass>
+  void record(int shift, bool skipped, size_t bytes, Pass &&pass) {
+    using namespace std::chrono;
+    auto begin = high_resolution_clock::now();
+    pass();
+    auto elapsed = high_resolution_clock::now() - begin;
+    records.push_back(
+        {shift, skipped, bytes,
+         static_cast<size_t>(duration_cast<nanoseconds>(elapsed).count())});
+  }
+
+  void histogram(const T *data, size_t n) {
+    size_t i = 0;
+#ifdef SORT_X86
+    if constexpr (sizeof(T) == sizeof(uint64_t)) {
+      if (has_avx2()) {
+        i = histogram_avx2(data, n);
+      }
+    }
+#endif
+    for (; i < n; ++i) {
+      for (int pass = 0; pass < pass_count; ++pass) {
+        ++counts[static_cast<size_t>(pass) * digits +
+                 digit(data[i], pass * bits)];
+      }
+    }
+  }
+
+#ifdef SORT_X86
+  static bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+  }
+
+  // digits of four keys per shift and mask; returns the keys counted
+  __attribute__((target("avx2"))) size_t histogram_avx2(const T *data,
+                                                        size_t n) {
+    const __m256i bias = _mm256_set1_epi64x(static_cast<int64_t>(BIAS));
+    const __m256i mask = _mm256_set1_epi64x(static_cast<int64_t>(digits - 1));
+    alignas(32) uint64_t lanes[4];
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m256i keys = _mm256_xor_si256(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)),
+          bias);
+      auto *count = counts.data();
+      for (int pass = 0; pass < pass_count; ++pass, count += digits) {
+        __m256i digit = _mm256_and_si256(
+            _mm256_srl_epi64(keys, _mm_cvtsi32_si128(pass * bits)), mask);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), digit);
+        ++count[lanes[0]];
+        ++count[lanes[1]];
+        ++count[lanes[2]];
+        ++count[lanes[3]];
+      }
+    }
+    return i;
+  }
+#endif
+
+  int bits;
+  size_t digits;
+  int pass_count;
+  std::vector<size_t> counts; ///< pass_count histograms of `digits` counts
+  std::vector<T> scratch;
+  std::vector<RadixPass> records;
+};
+
+} // namespace sort